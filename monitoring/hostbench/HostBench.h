@@ -0,0 +1,89 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file HostBench.h
+  *
+  * Common parts of the benchmarks: the allocation functions, they count every
+  * block in HostHeap, and the clocks. Include it in the one source file of a benchmark.
+  */
+#pragma once
+#include <malloc.h>
+#include "HostHeap.h"
+
+/* The allocation functions count every block for the statistic. */
+extern "C" void *__libc_malloc (size_t size);
+extern "C" void *__libc_calloc (size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void  __libc_free   (void *ptr);
+
+extern "C" void *malloc(size_t size)
+{
+   void *ptr = __libc_malloc(size);
+
+   if (ptr) {
+      HostHeap::onAlloc(malloc_usable_size(ptr));
+   }
+   return ptr;
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+   void *ptr = __libc_calloc(count, size);
+
+   if (ptr) {
+      HostHeap::onAlloc(malloc_usable_size(ptr));
+   }
+   return ptr;
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+   size_t oldSize = ptr ? malloc_usable_size(ptr) : 0;
+   void  *newPtr  = __libc_realloc(ptr, size);
+
+   if (newPtr) {
+      HostHeap::onFree(oldSize);
+      HostHeap::onAlloc(malloc_usable_size(newPtr));
+   }
+   return newPtr;
+}
+
+extern "C" void free(void *ptr)
+{
+   if (ptr) {
+      HostHeap::onFree(malloc_usable_size(ptr));
+   }
+   __libc_free(ptr);
+}
+
+/* Microseconds of the monotonic clock. */
+uint64_t GetMicros()
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Microseconds of cpu time of the process, the time blocked in select() does not count. */
+uint64_t GetCpuMicros()
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+   return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,161 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file HostSntp.h
+  *
+  * SNTP client of the host benchmarks like the one of the ESP32 (configTime):
+  * the clock starts at 1970 with the boot and follows the server after the
+  * first answer. Redirects gettimeofday() of the firmware, include it in the
+  * one source file of a benchmark before the firmware.
+  */
+#pragma once
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <atomic>
+
+#define HOST_SNTP_PORT     123          // Port of a server without ":port"
+#define HOST_SNTP_TIMEOUT  1000         // Wait for an answer (msec)
+#define HOST_SNTP_RETRY    1000         // Next request after a missing answer (msec)
+#define HOST_SNTP_INTERVAL 3600000      // Sync interval of the ESP32 SNTP client (msec)
+#define NTP_UNIX_OFFSET    2208988800LL // Seconds from 1900 to 1970
+
+/**
+  * The clock of the SNTP server.
+  */
+struct HostSntp
+{
+   static inline char                 server_[64];    //!< Host of the server
+   static inline uint16_t             port_;          //!< Port of the server
+   static inline std::atomic<int64_t> offset_{0};     //!< Server ahead of the host clock (usec)
+   static inline std::atomic<bool>    synced_{false}; //!< Is the offset from an answer?
+   static inline std::atomic<int>     answers_{0};    //!< Count of the answers
+
+   static int64_t hostMicros();
+   static int64_t fromNtp(const uint8_t *timestamp);
+   static void    toNtp  (int64_t micros, uint8_t *timestamp);
+   static bool    request(int64_t &offset);
+   static void    task   (void *);
+   static int     gettimeofday(struct timeval *tv, void *tz);
+};
+
+/* UTC time of the host in usec since 1970. */
+int64_t HostSntp::hostMicros()
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_REALTIME, &now);
+   return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* Usec since 1970 of a 64 bit NTP timestamp (seconds since 1900, 32 bit fraction). */
+int64_t HostSntp::fromNtp(const uint8_t *timestamp)
+{
+   uint32_t seconds  = ntohl(*(const uint32_t *) timestamp);
+   uint32_t fraction = ntohl(*(const uint32_t *) (timestamp + 4));
+
+   return ((int64_t) seconds - NTP_UNIX_OFFSET) * 1000000 + (((uint64_t) fraction * 1000000) >> 32);
+}
+
+/* 64 bit NTP timestamp of usec since 1970. */
+void HostSntp::toNtp(int64_t micros, uint8_t *timestamp)
+{
+   uint32_t seconds  = htonl((uint32_t) (micros / 1000000 + NTP_UNIX_OFFSET));
+   uint32_t fraction = htonl((uint32_t) (((uint64_t) (micros % 1000000) << 32) / 1000000));
+
+   memcpy(timestamp,     &seconds,  4);
+   memcpy(timestamp + 4, &fraction, 4);
+}
+
+/* One SNTP request (RFC 4330), the offset is ((T2 - T1) + (T3 - T4)) / 2. */
+bool HostSntp::request(int64_t &offset)
+{
+   struct sockaddr_in addr = {};
+   struct timeval     timeout = { HOST_SNTP_TIMEOUT / 1000, (HOST_SNTP_TIMEOUT % 1000) * 1000 };
+   uint8_t            packet[48] = { 0x23 }; // LI 0, VN 4, mode 3 (client)
+   uint8_t            sent[8];
+   int64_t            t1;
+   int64_t            t4;
+   ssize_t            length = -1;
+   int                sock   = socket(AF_INET, SOCK_DGRAM, 0);
+
+   addr.sin_family = AF_INET;
+   addr.sin_port   = htons(port_);
+   if (sock < 0 || inet_pton(AF_INET, server_, &addr.sin_addr) != 1) {
+      if (sock >= 0) {
+         close(sock);
+      }
+      return false;
+   }
+   setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+   t1 = hostMicros();
+   toNtp(t1, packet + 40);
+   memcpy(sent, packet + 40, sizeof(sent));
+   if (sendto(sock, packet, sizeof(packet), 0, (struct sockaddr *) &addr, sizeof(addr)) == sizeof(packet)) {
+      length = recv(sock, packet, sizeof(packet), 0);
+   }
+   t4 = hostMicros();
+   close(sock);
+   // A server answer to this request (originate = our transmit timestamp) with a clock.
+   if (length < (ssize_t) sizeof(packet) || (packet[0] & 0x07) != 4 || packet[1] == 0 ||
+       memcmp(packet + 24, sent, sizeof(sent)) != 0) {
+      return false;
+   }
+   offset = ((fromNtp(packet + 32) - t1) + (fromNtp(packet + 40) - t4)) / 2;
+   return true;
+}
+
+/* The SNTP task: request until the first answer, then sync every interval. */
+void HostSntp::task(void *)
+{
+   int64_t offset;
+
+   for (;;) {
+      if (request(offset)) {
+         offset_ = offset;
+         synced_ = true;
+         answers_++;
+         delay(HOST_SNTP_INTERVAL);
+      } else {
+         delay(HOST_SNTP_RETRY);
+      }
+   }
+}
+
+/* The time of the ESP32: since the boot at 1970 until the first answer, then the one of the server. */
+int HostSntp::gettimeofday(struct timeval *tv, void *)
+{
+   int64_t micros = synced_ ? hostMicros() + offset_ : (int64_t) millis() * 1000;
+
+   tv->tv_sec  = micros / 1000000;
+   tv->tv_usec = micros % 1000000;
+   return 0;
+}
+
+/* Start the SNTP task with "host[:port]" (an IPv4 address), the time zone is UTC. */
+void configTime(long, int, const char *server)
+{
+   const char *colon = strchr(server, ':');
+   size_t      length = colon ? (size_t) (colon - server) : strlen(server);
+
+   snprintf(HostSntp::server_, sizeof(HostSntp::server_), "%.*s", (int) length, server);
+   HostSntp::port_ = colon ? (uint16_t) atoi(colon + 1) : HOST_SNTP_PORT;
+   xTaskCreate(HostSntp::task, "sntp", 4096, NULL, 1, NULL);
+}
+
+#define gettimeofday HostSntp::gettimeofday //!< The firmware reads the clock of the SNTP client
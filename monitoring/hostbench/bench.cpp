@@ -0,0 +1,467 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file bench.cpp
+  *
+  * Host benchmark of the IoBroker layer of one display firmware.
+  * Runs the wakes of the device (load snapshot, GetIoBrokerValues(), save
+  * snapshot) against the mock server (mock_iobroker.py) and reports the wall
+  * time, the cpu time, the bytes, the requests and the heap allocations of
+  * every wake.
+  * The history and snapshot files are kept in a host directory, so the
+  * first wake is a cold start and the following ones use the stored data.
+  * Built with BENCH_MQTT the current values are the retained messages of the
+  * broker of the mock server (DATA_SOURCE_MQTT), the histories stay http.
+  *
+  *   bench [--host 127.0.0.1] [--port 8087] [--mqtt-port 1883] [--wakes 3] [--interval 600] [--fs dir]
+  *   bench --ids               print the bound state ids for the recorder
+  *   bench --tokenizer [n]     points/s of the HistoryTokenizer with n points
+  *   bench --binning [n]       ns per point of the history binning with n points
+  *   bench ... --yield         check the counted days of the energies after the wakes (synthetic server, TZ=UTC)
+  */
+#if defined(BENCH_M5PAPER)
+  #include <M5EPD.h>
+#elif defined(BENCH_INPLATE6PLUS)
+  #include <Inkplate.h>
+#else
+  #error "Define BENCH_M5PAPER or BENCH_INPLATE6PLUS"
+#endif
+#include "RTClib.h"
+#include <TimeLib.h>
+#include <WiFi.h>
+#include <vector>
+#include <sys/stat.h>
+#include "Config.h"
+
+// The server of the benchmark instead of the IoBroker of the config.
+#undef  IOBROKER_URL
+#undef  IOBROKER_PORT
+#define IOBROKER_URL  benchHost
+#define IOBROKER_PORT benchPort
+
+#if defined(BENCH_MQTT)
+// The current values from the mqtt broker of the mock server.
+#undef  DATA_SOURCE
+#undef  MQTT_SERVER
+#undef  MQTT_PORT
+#define DATA_SOURCE DATA_SOURCE_MQTT
+#define MQTT_SERVER benchHost
+#define MQTT_PORT   benchMqttPort
+#endif
+
+const char *benchHost     = "127.0.0.1"; //!< Host of the mock server
+uint16_t    benchPort     = 8087;        //!< Port of the mock server
+uint16_t    benchMqttPort = 1883;        //!< Mqtt port of the mock server (BENCH_MQTT)
+
+#include "Log.h"
+#include "Data.h"
+#include "IoBroker.h"
+#include "Snapshot.h"
+#include "HostBench.h"
+
+#if defined(BENCH_INPLATE6PLUS)
+Inkplate display; //!< RTC of the device
+#endif
+
+#define BENCH_TOKENIZER_POINTS 1000000 // Default points of the tokenizer benchmark
+#define BENCH_TOKENIZER_RUNS   5       // The best of these runs is reported
+#define BENCH_BINNING_POINTS   1000000 // Default points of the binning benchmark
+#define BENCH_TIME_ZONE        "CET-1CEST,M3.5.0,M10.5.0/3" // Zone of the device (RTCTime.h) if TZ is not set
+#define BENCH_YIELD_TOLERANCE  0.005   // Max relative error of a counted day
+#define BENCH_YIELD_MIN_ERROR  0.01    // Max error of a counted day without energy (kWh)
+
+/** Daily energy of one counter of the synthetic server (kWh), its days are UTC days */
+struct BenchYield
+{
+   const char                *name;    //!< Name in the output
+   EnergyCounter EnergyData::*counter; //!< Counter of the MyData
+   double                     in;      //!< Positive energy of a day
+   double                     out;     //!< Negative energy of a day
+};
+
+/** The powers of mock_iobroker.py --synthetic integrated over one day */
+const BenchYield BENCH_YIELDS[] = {
+   { "solar",   &EnergyData::solar,   6.1115, 0.0    }, // 800 W * 24 h / pi
+   { "battery", &EnergyData::battery, 3.4125, 3.3009 }, // the solar power minus 250 W
+   { "grid",    &EnergyData::grid,    3.6,    0.0    }, // 150 W, the sine cancels
+};
+
+/* Tell the mock server the clock offset of the simulated wake, it is not part of the statistic. */
+bool SetServerClock(time_t offset)
+{
+   WiFiClient client;
+   String     response;
+   int        c;
+
+   if (!client.connect(benchHost, benchPort)) {
+      return false;
+   }
+   client.print("GET /bench/clock?offset=" + String((long) offset) + " HTTP/1.1\r\nConnection: close\r\n\r\n");
+   while (client.connected()) {
+      fd_set readSet;
+
+      FD_ZERO(&readSet);
+      FD_SET(client.fd(), &readSet);
+      select(client.fd() + 1, &readSet, NULL, NULL, NULL);
+      while ((c = client.read()) >= 0) {
+         response += (char) c;
+      }
+   }
+   return response.startsWith("HTTP/1.1 200");
+}
+
+/* Print the ids of the bound states, one per line with the type and the days of a history. */
+void PrintIds()
+{
+   static const char *types[] = { "double", "string", "timestamp", "history", "energy" };
+
+   for (size_t i = 0; i < BINDING_COUNT(IOBROKER_BINDINGS); i++) {
+      const IoBrokerBinding &binding = IOBROKER_BINDINGS[i];
+
+      printf("%s %s %d\n", binding.id, types[binding.type], binding.days);
+   }
+}
+
+/* Is the counted energy within the tolerance of the expected one? */
+bool IsYieldOk(double energy, double expected)
+{
+   return fabs(energy - expected) <= max(expected * BENCH_YIELD_TOLERANCE, BENCH_YIELD_MIN_ERROR);
+}
+
+/* 
+ * Compare the complete counted days of the energies with the synthetic server, the
+ * seeded days before the first integrated point are not checked.
+ * Returns the count of the wrong counters.
+ */
+int CheckYields(MyData &myData)
+{
+   const time_t day    = 24 * 60 * 60;
+   int          errors = 0;
+
+   for (const BenchYield &yield : BENCH_YIELDS) {
+      EnergyCounter &counter = myData.energy.*yield.counter;
+      time_t         first   = (UtcToLocalTime(counter.firstTime_) + day - 1) / day * day;
+      time_t         last    = UtcToLocalTime(counter.lastTime_) / day * day; // the current day is not complete
+      int            days    = 0;
+
+      for (time_t time = first; counter.firstTime_ > 0 && time + day <= last; time += day) {
+         double in  = counter.getEnergy(counter.daysIn_,  time);
+         double out = counter.getEnergy(counter.daysOut_, time);
+         bool   ok  = IsYieldOk(in, yield.in) && IsYieldOk(out, yield.out);
+         char   date[16];
+
+         strftime(date, sizeof(date), "%Y-%m-%d", gmtime(&time));
+         printf("yield %s %s: in %.3f kWh (%.3f), out %.3f kWh (%.3f)%s\n",
+                yield.name, date, in, yield.in, out, yield.out, ok ? "" : ", WRONG");
+         if (!ok) {
+            days = -1;
+            break;
+         }
+         days++;
+      }
+      if (days <= 0) {
+         printf("yield %s: %s\n", yield.name, days < 0 ? "wrong day" : "no complete day counted");
+         errors++;
+      }
+   }
+   return errors;
+}
+
+/* Run the wakes against the mock server, at last the yields are checked if wanted. Returns the process exit code. */
+int RunWakes(int wakes, time_t interval, bool yield)
+{
+   uint64_t totalMicros   = 0;
+   uint64_t totalCpu      = 0;
+   uint64_t totalBytes    = 0;
+   uint64_t totalRequests = 0;
+
+   for (int wake = 0; wake < wakes; wake++) {
+      MyData   myData;
+      bool     ok;
+      uint64_t start;
+      uint64_t micros;
+      uint64_t cpuStart;
+      uint64_t cpuMicros;
+      uint64_t allocations;
+      uint64_t allocated;
+
+      HostClock::offset_ = wake * interval;
+      if (!SetServerClock(HostClock::offset_)) {
+         fprintf(stderr, "No mock server at %s:%u\n", benchHost, benchPort);
+         return 1;
+      }
+      WiFiStatistic::reset();
+      HostHeap::resetMax();
+      allocations = HostHeap::allocations_;
+      allocated   = HostHeap::allocated_;
+      start       = GetMicros();
+      cpuStart    = GetCpuMicros();
+
+      LoadSnapshot(myData);
+      ok = GetIoBrokerValues(myData);
+      if (ok) {
+         SaveSnapshot(myData);
+      }
+
+      micros      = GetMicros() - start;
+      cpuMicros   = GetCpuMicros() - cpuStart;
+      allocations = HostHeap::allocations_ - allocations;
+      allocated   = HostHeap::allocated_   - allocated;
+      logger.flush(LOG_FLUSH_TIMEOUT);
+      printf("wake %d (+%ld s): %.1f ms, %.1f ms cpu, %u requests, %u connects, %llu bytes sent, %llu bytes received, "
+             "%llu allocations (%llu bytes), %lld bytes peak heap, %d missing%s\n",
+             wake + 1, (long) HostClock::offset_, micros / 1000.0, cpuMicros / 1000.0, WiFiStatistic::requests_, WiFiStatistic::connects_,
+             (unsigned long long) WiFiStatistic::sentBytes_, (unsigned long long) WiFiStatistic::receivedBytes_,
+             (unsigned long long) allocations, (unsigned long long) allocated, (long long) HostHeap::maxUsed_.load(),
+             myData.missingValues, ok ? "" : ", FAILED");
+      totalMicros   += micros;
+      totalCpu      += cpuMicros;
+      totalBytes    += WiFiStatistic::sentBytes_ + WiFiStatistic::receivedBytes_;
+      totalRequests += WiFiStatistic::requests_;
+      if (yield && wake == wakes - 1 && CheckYields(myData) > 0) {
+         return 1;
+      }
+   }
+   printf("total: %.1f ms, %llu requests, %llu bytes, %.1f ms, %.1f ms cpu and %llu bytes per wake\n",
+          totalMicros / 1000.0, (unsigned long long) totalRequests, (unsigned long long) totalBytes,
+          totalMicros / 1000.0 / wakes, totalCpu / 1000.0 / wakes, (unsigned long long) (totalBytes / wakes));
+   return 0;
+}
+
+/* Parse a synthetic history result with the HistoryTokenizer and print the points/s. */
+int RunTokenizer(long points)
+{
+   std::string      json = "[{\"target\":\"mqtt.0.bmv.SOC\",\"datapoints\":[";
+   HistoryTokenizer tokenizer;
+   uint64_t         best = 0;
+   long             count = 0;
+   double           sum   = 0.0;
+
+   for (long i = 0; i < points; i++) {
+      char pair[64];
+
+      snprintf(pair, sizeof(pair), "%s[%.1f,%llu]", i > 0 ? "," : "",
+               500.0 + 450.0 * sin(i / 300.0), 1666000000000ULL + (unsigned long long) i * 60000);
+      json += pair;
+   }
+   json += "]}]";
+
+   for (int run = 0; run < BENCH_TOKENIZER_RUNS; run++) {
+      uint64_t start = GetMicros();
+      uint64_t micros;
+
+      tokenizer.reset();
+      count = 0;
+      for (char c : json) {
+         if (tokenizer.push(c)) {
+            sum += tokenizer.getValue() + tokenizer.getTimestamp();
+            count++;
+         }
+      }
+      micros = GetMicros() - start;
+      if (best == 0 || micros < best) {
+         best = micros;
+      }
+   }
+   printf("tokenizer: %ld points, %zu bytes, %.1f ms, %.2f Mpoints/s, %.1f MB/s (checksum %g)\n",
+          count, json.size(), best / 1000.0, count / (double) best, json.size() / (double) best, sum);
+   return count == points ? 0 : 1;
+}
+
+/**
+  * Calendar math of the RTClib DateTime of the device, the stub only keeps the seconds.
+  * The constructor splits the seconds into the fields, secondstime() joins them again.
+  */
+class DeviceDateTime
+{
+protected:
+   uint8_t yOff_; //!< Years since 2000
+   uint8_t m_;    //!< Month 1..12
+   uint8_t d_;    //!< Day 1..31
+   uint8_t hh_;   //!< Hour
+   uint8_t mm_;   //!< Minute
+   uint8_t ss_;   //!< Second
+
+   static const uint8_t daysInMonth_[11]; //!< Days of the months up to november
+
+public:
+   DeviceDateTime(uint32_t t)
+   {
+      uint16_t days;
+      bool     leap;
+
+      t  -= 946684800UL; // seconds from 1970 to 2000
+      ss_ = t % 60;
+      t  /= 60;
+      mm_ = t % 60;
+      t  /= 60;
+      hh_ = t % 24;
+      days = t / 24;
+      for (yOff_ = 0;; yOff_++) {
+         leap = yOff_ % 4 == 0;
+         if (days < 365U + leap) {
+            break;
+         }
+         days -= 365 + leap;
+      }
+      for (m_ = 1; m_ < 12; m_++) {
+         uint8_t daysPerMonth = daysInMonth_[m_ - 1] + (leap && m_ == 2 ? 1 : 0);
+
+         if (days < daysPerMonth) {
+            break;
+         }
+         days -= daysPerMonth;
+      }
+      d_ = days + 1;
+   }
+
+   uint32_t secondstime() const
+   {
+      uint16_t days = d_;
+
+      for (int i = 1; i < m_; i++) {
+         days += daysInMonth_[i - 1];
+      }
+      if (m_ > 2 && yOff_ % 4 == 0) {
+         days++;
+      }
+      days += 365 * yOff_ + (yOff_ + 3) / 4 - 1;
+      return ((days * 24UL + hh_) * 60 + mm_) * 60 + ss_;
+   }
+};
+
+const uint8_t DeviceDateTime::daysInMonth_[11] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30 };
+
+/* Best time (usec) of binning the timestamps with the function, the sum of the indexes keeps the work. */
+template <typename BinFunction>
+uint64_t TimeBinning(const std::vector<uint32_t> &timestamps, BinFunction bin, int64_t &sum)
+{
+   uint64_t best = 0;
+
+   for (int run = 0; run < BENCH_TOKENIZER_RUNS; run++) {
+      uint64_t start = GetMicros();
+      uint64_t micros;
+
+      for (uint32_t timestamp : timestamps) {
+         sum += bin(timestamp);
+      }
+      micros = GetMicros() - start;
+      if (best == 0 || micros < best) {
+         best = micros;
+      }
+   }
+   return best;
+}
+
+/* 
+ * Bin random points into every tier of the HistoryArchive: the RTClib DateTime and
+ * double math of the original parser against the fixed point reciprocal of IoBrokerHistory
+ * and a plain division. Every offset of a tier must give the bucket of the division.
+ */
+int RunBinning(long points)
+{
+   int errors = 0;
+
+   for (int tier = 0; tier < HISTORY_TIER_COUNT; tier++) {
+      volatile int          tierStep   = HISTORY_TIERS[tier].step; // no constant division for the compiler
+      int                   step       = tierStep;
+      int                   size       = HISTORY_TIERS[tier].days * 24 * 60 * 60 / step;
+      uint32_t              span       = (uint32_t) step * size;
+      uint32_t              start      = 1666000000UL / step * step;
+      uint64_t              reciprocal = IoBrokerHistory::getReciprocal(step, span);
+      DeviceDateTime        fromDate(start);
+      DeviceDateTime        toDate(start + span);
+      std::vector<uint32_t> timestamps(points);
+      uint32_t              random     = 1;
+      int64_t               sum[3]     = { 0 };
+      uint64_t              micros[3];
+      bool                  exact      = true;
+
+      for (uint32_t &timestamp : timestamps) {
+         random    = random * 1664525UL + 1013904223UL;
+         timestamp = start + random % span;
+      }
+      micros[0] = TimeBinning(timestamps, [&](uint32_t timestamp) {
+         DeviceDateTime jsonDate(timestamp);
+
+         return (int) ((double) size / (double) (toDate.secondstime() - fromDate.secondstime()) * (double) (jsonDate.secondstime() - fromDate.secondstime()));
+      }, sum[0]);
+      micros[1] = TimeBinning(timestamps, [&](uint32_t timestamp) {
+         return IoBrokerHistory::getBucket(timestamp - start, step, reciprocal);
+      }, sum[1]);
+      micros[2] = TimeBinning(timestamps, [&](uint32_t timestamp) {
+         return (int) ((timestamp - start) / (uint32_t) step);
+      }, sum[2]);
+      for (uint32_t offset = 0; offset < span && exact; offset++) {
+         exact = IoBrokerHistory::getBucket(offset, step, reciprocal) == (int) (offset / (uint32_t) step);
+      }
+      if (!exact || sum[1] != sum[2]) {
+         errors++;
+      }
+      printf("binning %d s x %d: %ld points, DateTime/double %.2f ns, reciprocal %.2f ns, division %.2f ns per point, %s (checksum %lld)\n",
+             step, size, points, micros[0] * 1000.0 / points, micros[1] * 1000.0 / points, micros[2] * 1000.0 / points,
+             !exact ? "NOT EXACT" : reciprocal > 0 ? "exact" : "divided", (long long) (sum[0] + sum[1] + sum[2]));
+   }
+   return errors > 0 ? 1 : 0;
+}
+
+/* Command line: see the file comment. */
+int main(int argc, char *argv[])
+{
+   const char *fsRoot   = "fs";
+   int         wakes    = 3;
+   time_t      interval = 10 * 60;
+   bool        yield    = false;
+
+   for (int i = 1; i < argc; i++) {
+      const char *arg  = argv[i];
+      const char *next = i + 1 < argc ? argv[i + 1] : NULL;
+
+      if (strcmp(arg, "--ids") == 0) {
+         PrintIds();
+         return 0;
+      } else if (strcmp(arg, "--tokenizer") == 0) {
+         return RunTokenizer(next && isdigit(*next) ? atol(next) : BENCH_TOKENIZER_POINTS);
+      } else if (strcmp(arg, "--binning") == 0) {
+         return RunBinning(next && isdigit(*next) ? atol(next) : BENCH_BINNING_POINTS);
+      } else if (strcmp(arg, "--host") == 0 && next) {
+         benchHost = argv[++i];
+      } else if (strcmp(arg, "--port") == 0 && next) {
+         benchPort = (uint16_t) atoi(argv[++i]);
+      } else if (strcmp(arg, "--mqtt-port") == 0 && next) {
+         benchMqttPort = (uint16_t) atoi(argv[++i]);
+      } else if (strcmp(arg, "--wakes") == 0 && next) {
+         wakes = atoi(argv[++i]);
+      } else if (strcmp(arg, "--interval") == 0 && next) {
+         interval = atol(argv[++i]);
+      } else if (strcmp(arg, "--fs") == 0 && next) {
+         fsRoot = argv[++i];
+      } else if (strcmp(arg, "--yield") == 0) {
+         yield = true;
+      } else {
+         fprintf(stderr, "Usage: %s [--host h] [--port p] [--mqtt-port p] [--wakes n] [--interval sec] [--fs dir] [--yield] | --ids | --tokenizer [points] | --binning [points]\n", argv[0]);
+         return 2;
+      }
+   }
+   // Without TZ the host libc reads /etc/localtime on every localtime(), the device has a zone string.
+   setenv("TZ", BENCH_TIME_ZONE, 0);
+   tzset();
+   mkdir(fsRoot, 0755);
+   SPIFFS.setRoot(fsRoot);
+   logger.begin();
+   return RunWakes(wakes < 1 ? 1 : wakes, interval, yield);
+}
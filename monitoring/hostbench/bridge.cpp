@@ -0,0 +1,271 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file bridge.cpp
+  *
+  * Host benchmark of the publish cycle of the ve.direct to mqtt bridge.
+  * Runs setup() and loop() of vedirect.ino against the broker of the mock server
+  * (mock_iobroker.py --mqtt-port). Every cycle moves millis() past the send
+  * interval, writes one BMV and one MPPT block into the serial ports in chunks
+  * and calls loop() until both blocks are published. Reports the wall time, the
+  * cpu time, the sent bytes, the checksum errors and the heap allocations of
+  * every cycle.
+  * With --ntp-port the SNTP client syncs with the mock server (mock_iobroker.py
+  * --ntp-port --clock-offset), every cycle checks the acquisition timestamp of
+  * both blocks against the clock of the server at their first byte.
+  *
+  *   bridge [--host 127.0.0.1] [--mqtt-port 1883] [--ntp-port 123 --clock-offset 0] [--cycles 10] [--chunk 32]
+  */
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include "HostBench.h"
+#include "HostSntp.h"
+
+const char *benchHost          = "127.0.0.1"; //!< Host of the mock server
+uint16_t    benchMqttPort      = 1883;        //!< Mqtt port of the mock server
+char        benchNtpServer[32] = "";          //!< "host:port" of the SNTP server, empty = none
+
+#include "vedirect.ino"
+
+#ifndef BENCH_CONFIG_OVERRIDE
+  #error "The ConfigOverride.h of mqqtbridge/vedirect hides the one of the benchmark (stubs/bridge)"
+#endif
+
+#define BENCH_CYCLES     10  // Default count of the publish cycles
+#define BENCH_CHUNK      32  // Default bytes written into a serial port per loop()
+#define BENCH_MAX_LOOPS  100 // Max loops after the last byte until both blocks are published
+#define BENCH_BLOCK_SIZE 512 // Max length of one generated block
+#define BENCH_SNTP_WAIT  3000 // Max wait for the first SNTP answer (msec)
+#define BENCH_TIME_ERROR 20   // Max difference of a timestamp to the server clock (msec)
+
+/** One label of a generated ve.direct block, "%d" values get the cycle */
+struct BenchField
+{
+   const char *keyword; //!< Label
+   const char *value;   //!< Value or format
+   int         base;    //!< Value of the first cycle of a format
+};
+
+/** Main block of a BMV-712 (victron-ve-direct-protocol.pdf) */
+const BenchField BENCH_BMV_BLOCK[] = {
+   { "PID", "0xA381", 0 }, { "V", "%d", 12800 }, { "VS", "%d", 13010 }, { "I", "%d", -3200 },
+   { "P", "%d", -41 }, { "CE", "%d", -18500 }, { "SOC", "%d", 876 }, { "TTG", "%d", 1440 },
+   { "Alarm", "OFF", 0 }, { "Relay", "OFF", 0 }, { "AR", "0", 0 }, { "BMV", "712 Smart", 0 },
+   { "FW", "0413", 0 }, { "MON", "0", 0 }
+};
+
+/** Block of a SmartSolar MPPT */
+const BenchField BENCH_MPPT_BLOCK[] = {
+   { "PID", "0xA053", 0 }, { "FW", "159", 0 }, { "SER#", "HQ2132ABCDE", 0 }, { "V", "%d", 13020 },
+   { "I", "%d", 4600 }, { "VPV", "%d", 36500 }, { "PPV", "%d", 62 }, { "CS", "3", 0 },
+   { "MPPT", "2", 0 }, { "OR", "0x00000000", 0 }, { "ERR", "0", 0 }, { "LOAD", "ON", 0 },
+   { "IL", "300", 0 }, { "H19", "%d", 10234 }, { "H20", "45", 0 }, { "H21", "410", 0 },
+   { "H22", "52", 0 }, { "H23", "430", 0 }, { "HSDS", "123", 0 }
+};
+
+/**
+  * One ve.direct block on its way into a serial port.
+  */
+struct BenchBlock
+{
+   HardwareSerial &serial;                   //!< Port of the device
+   char            text[BENCH_BLOCK_SIZE];   //!< The block with the checksum
+   size_t          length;                   //!< Length of the block
+   size_t          written;                  //!< Bytes already in the port
+
+   BenchBlock(HardwareSerial &port) : serial(port), length(0), written(0) {}
+
+   void format(const BenchField *fields, int count, int cycle);
+   bool write (size_t chunk);
+};
+
+/* Format the block "\r\nLabel\tValue...\r\nChecksum\t<byte>", the sum of all bytes is 0. */
+void BenchBlock::format(const BenchField *fields, int count, int cycle)
+{
+   uint8_t sum = 0;
+
+   length  = 0;
+   written = 0;
+   for (int i = 0; i < count; i++) {
+      length += snprintf(text + length, sizeof(text) - length, "\r\n%s\t", fields[i].keyword);
+      length += snprintf(text + length, sizeof(text) - length, fields[i].value, fields[i].base + cycle);
+   }
+   length += snprintf(text + length, sizeof(text) - length, "\r\nChecksum\t");
+   for (size_t i = 0; i < length; i++) {
+      sum += (uint8_t) text[i];
+   }
+   text[length++] = (char) (uint8_t) -sum;
+}
+
+/* Write the next chunk as far as the receive buffer has room. Returns false if all is written. */
+bool BenchBlock::write(size_t chunk)
+{
+   if (written < length) {
+      written += serial.receive((const uint8_t *) text + written, min(chunk, length - written));
+   }
+   return written < length;
+}
+
+/* Wait for the first answer of the SNTP server. */
+bool WaitSntp()
+{
+   uint64_t start = GetMicros();
+
+   while (HostSntp::answers_ == 0 && GetMicros() - start < BENCH_SNTP_WAIT * 1000) {
+      delay(1);
+   }
+   if (HostSntp::answers_ == 0) {
+      fprintf(stderr, "No SNTP answer from %s\n", benchNtpServer);
+      return false;
+   }
+   printf("sntp: synced after %.1f ms, server clock %+.3f s ahead\n", (GetMicros() - start) / 1000.0,
+          HostSntp::offset_ / 1000000.0);
+   return true;
+}
+
+/* Difference of the timestamp of a block to the server clock at its first byte (msec), "-" if not stamped. */
+void FormatTimeError(char *text, size_t size, uint64_t frameTime, int64_t serverMillis)
+{
+   if (frameTime == 0) {
+      snprintf(text, size, "-");
+   } else {
+      snprintf(text, size, "%+lld ms", (long long) ((int64_t) frameTime - serverMillis));
+   }
+}
+
+/* Run the setup and the publish cycles, clockOffset is the server clock ahead of the host (sec). Returns the exit code. */
+int RunCycles(int cycles, size_t chunk, double clockOffset)
+{
+   BenchBlock bmv(Serial1);
+   BenchBlock mppt(Serial2);
+   uint64_t   allocations = HostHeap::allocations_;
+   uint64_t   allocated   = HostHeap::allocated_;
+   uint64_t   steady      = 0;
+   WiFiClient broker;
+
+   if (!broker.connect(benchHost, benchMqttPort)) {
+      fprintf(stderr, "No mqtt broker at %s:%u\n", benchHost, benchMqttPort);
+      return 1;
+   }
+   broker.stop();
+   setup();
+   logger.flush(LOG_FLUSH_TIMEOUT);
+   printf("setup: %llu allocations (%llu bytes)\n", (unsigned long long) (HostHeap::allocations_ - allocations),
+          (unsigned long long) (HostHeap::allocated_ - allocated));
+   if (benchNtpServer[0] && !WaitSntp()) {
+      return 1;
+   }
+
+   for (int cycle = 0; cycle < cycles; cycle++) {
+      int      bmvSend     = bmvMqqtSend;
+      int      mpptSend    = mpptMqqtSend;
+      int      errors      = bmvCheckSumError + mpptCheckSumError;
+      int      loops       = 0;
+      int      rest        = BENCH_MAX_LOOPS;
+      bool     writing     = true;
+      uint64_t bmvTime     = 0;
+      uint64_t mpptTime    = 0;
+      int64_t  firstByte;
+      bool     timeOk;
+      char     bmvError[24];
+      char     mpptError[24];
+      uint64_t start;
+      uint64_t micros;
+      uint64_t cpuStart;
+      uint64_t cpuMicros;
+
+      HostClock::millisOffset_ += SEND_EVEREY_MILLIS;
+      bmv.format(BENCH_BMV_BLOCK, KEYWORD_COUNT(BENCH_BMV_BLOCK), cycle);
+      mppt.format(BENCH_MPPT_BLOCK, KEYWORD_COUNT(BENCH_MPPT_BLOCK), cycle);
+      WiFiStatistic::reset();
+      allocations = HostHeap::allocations_;
+      allocated   = HostHeap::allocated_;
+      start       = GetMicros();
+      cpuStart    = GetCpuMicros();
+      firstByte   = (HostSntp::hostMicros() + (int64_t) (clockOffset * 1000000)) / 1000;
+
+      while ((writing || bmvMqqtSend == bmvSend || mpptMqqtSend == mpptSend) && rest > 0) {
+         writing  = bmv.write(chunk);
+         writing |= mppt.write(chunk);
+         loop();
+         loops++;
+         rest -= writing ? 0 : 1;
+         // The reader resets the block with the next readLine().
+         bmvTime  = veDirectReader1.isBlockCompleted() && !bmvTime  ? veDirectReader1.frameTime_ : bmvTime;
+         mpptTime = veDirectReader2.isBlockCompleted() && !mpptTime ? veDirectReader2.frameTime_ : mpptTime;
+      }
+
+      micros      = GetMicros() - start;
+      cpuMicros   = GetCpuMicros() - cpuStart;
+      allocations = HostHeap::allocations_ - allocations;
+      allocated   = HostHeap::allocated_   - allocated;
+      steady     += cycle > 0 ? allocations : 0;
+      timeOk      = !benchNtpServer[0] || (llabs((int64_t) bmvTime  - firstByte) <= BENCH_TIME_ERROR &&
+                                           llabs((int64_t) mpptTime - firstByte) <= BENCH_TIME_ERROR);
+      FormatTimeError(bmvError,  sizeof(bmvError),  bmvTime,  firstByte);
+      FormatTimeError(mpptError, sizeof(mpptError), mpptTime, firstByte);
+      logger.flush(LOG_FLUSH_TIMEOUT);
+      printf("cycle %d: %.1f ms, %.1f ms cpu, %d loops, %u connects, %llu bytes sent, %llu allocations (%llu bytes), "
+             "%d checksum errors, timestamp bmv %s mppt %s%s%s\n",
+             cycle + 1, micros / 1000.0, cpuMicros / 1000.0, loops, WiFiStatistic::connects_,
+             (unsigned long long) WiFiStatistic::sentBytes_, (unsigned long long) allocations, (unsigned long long) allocated,
+             bmvCheckSumError + mpptCheckSumError - errors, bmvError, mpptError,
+             rest > 0 ? "" : ", NOT PUBLISHED", timeOk ? "" : ", TIMESTAMP WRONG");
+      if (rest == 0 || !timeOk) {
+         return 1;
+      }
+   }
+   if (cycles > 1) {
+      printf("total: %.1f allocations per cycle after the first\n", (double) steady / (cycles - 1));
+   }
+   return 0;
+}
+
+int main(int argc, char *argv[])
+{
+   int    cycles      = BENCH_CYCLES;
+   size_t chunk       = BENCH_CHUNK;
+   int    ntpPort     = 0;
+   double clockOffset = 0;
+
+   for (int i = 1; i < argc; i++) {
+      const char *arg  = argv[i];
+      const char *next = i + 1 < argc ? argv[i + 1] : NULL;
+
+      if (strcmp(arg, "--host") == 0 && next) {
+         benchHost = argv[++i];
+      } else if (strcmp(arg, "--mqtt-port") == 0 && next) {
+         benchMqttPort = (uint16_t) atoi(argv[++i]);
+      } else if (strcmp(arg, "--ntp-port") == 0 && next) {
+         ntpPort = atoi(argv[++i]);
+      } else if (strcmp(arg, "--clock-offset") == 0 && next) {
+         clockOffset = atof(argv[++i]);
+      } else if (strcmp(arg, "--cycles") == 0 && next) {
+         cycles = atoi(argv[++i]);
+      } else if (strcmp(arg, "--chunk") == 0 && next) {
+         chunk = (size_t) atoi(argv[++i]);
+      } else {
+         fprintf(stderr, "usage: %s [--host 127.0.0.1] [--mqtt-port 1883] [--ntp-port 123 --clock-offset 0] [--cycles 10] [--chunk 32]\n",
+                 argv[0]);
+         return 2;
+      }
+   }
+   if (ntpPort > 0) {
+      snprintf(benchNtpServer, sizeof(benchNtpServer), "%s:%d", benchHost, ntpPort);
+   }
+   return RunCycles(cycles, chunk > 0 ? chunk : 1, clockOffset);
+}
@@ -0,0 +1,505 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2022 SFini
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Stand-in for the ioBroker simple-api and history adapter of the display firmwares.
+
+Serves /getPlainValue/, /get/, /getBulk/ and /query/ with keep-alive and
+pipelining from a recorded dataset or from synthetic values:
+
+  mock_iobroker.py [--port 8087] --synthetic [--period 60]
+  mock_iobroker.py [--port 8087] --dataset dataset.json
+  mock_iobroker.py --synthetic --mqtt-port 1883 --ids ids.txt
+  mock_iobroker.py record --source http://iobroker:8087 --ids ids.txt [--days 30] --out dataset.json
+
+A dataset is replayed relative to the current time, the newest recorded
+point is 'now'. 'bench --ids > ids.txt' writes the ids of the firmware.
+GET /bench/clock?offset=sec moves the clock of the server like the RTC of
+the benchmark.
+
+With --mqtt-port the current states are retained messages of an MQTT 3.1.1
+broker too, like the ve.direct bridge and the Tasmota plug publish them
+('mqtt.0.bmv.CE' -> 'bmv/CE', the Tasmota ENERGY values in one SENSOR
+message). The synthetic source needs the ids of the firmware (--ids),
+without them the broker has no retained messages, e.g. for the bridge
+benchmark which only publishes.
+
+With --ntp-port the clock of the server (--clock-offset sec ahead of the
+host) answers SNTP requests too, like pool.ntp.org for the bridge.
+
+Only the python standard library is used.
+"""
+
+import argparse
+import gzip
+import json
+import math
+import socket
+import socketserver
+import struct
+import sys
+import threading
+import time
+import urllib.parse
+import urllib.request
+import zlib
+from datetime import datetime, timezone
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+DAY = 24 * 60 * 60
+
+
+def parse_date(text):
+    """ISO date of the firmware ('2026-10-18T12:00:00Z') or milliseconds to seconds."""
+    if text.isdigit():
+        return int(text) / 1000.0
+    return datetime.strptime(text, '%Y-%m-%dT%H:%M:%SZ').replace(tzinfo=timezone.utc).timestamp()
+
+
+class Clock:
+    """System time with the offset of the simulated wake."""
+    offset = 0
+
+    @classmethod
+    def now(cls):
+        return time.time() + cls.offset
+
+
+class SyntheticSource:
+    """Values calculated from the id and the time, one point every 'period' seconds."""
+
+    STRINGS = {'Relay': 'OFF', 'alive': 'Online'}
+
+    def __init__(self, period):
+        self.period = period
+
+    def is_string(self, state_id):
+        return state_id.rsplit('.', 1)[-1] in self.STRINGS
+
+    def value(self, state_id, t):
+        name = state_id.rsplit('.', 1)[-1]
+        day = (t % DAY) / DAY
+        sun = max(0.0, math.sin(math.pi * (day - 0.25) * 2.0))
+        if name in self.STRINGS:
+            return self.STRINGS[name]
+        if name == 'Timestamp':
+            return int(t)
+        if name == 'SOC':
+            return round(700.0 + 250.0 * math.sin(2.0 * math.pi * (day - 0.375)))
+        if name == 'PPV':
+            return round(800.0 * sun)
+        if name == 'P':
+            return round(800.0 * sun - 250.0)
+        if name == 'ENERGY_Power':
+            return round(150.0 + 100.0 * math.sin(2.0 * math.pi * day * 3.0), 1)
+        if name in ('V', 'ENERGY_Voltage'):
+            return round((13.2 if name == 'V' else 230.0) + 0.4 * math.sin(2.0 * math.pi * day), 2)
+        return (zlib.crc32(state_id.encode()) % 1000) / 10.0
+
+    def last_time(self, state_id):
+        return math.floor(Clock.now() / self.period) * self.period
+
+    def state(self, state_id):
+        # the bridge publishes the value again and again, only 'lc' stays at the change
+        t = self.last_time(state_id)
+        return {'val': self.value(state_id, t), 'ts': int(Clock.now() * 1000), 'lc': int(t * 1000)}
+
+    def points(self, state_id, start, end, resolution=0):
+        """Points between start and end, a coarser resolution (sec) thins them out for an aggregation."""
+        period = max(self.period, math.floor(resolution / self.period) * self.period)
+        t = math.ceil(start / period) * period
+        end = min(end, Clock.now())
+        while t <= end:
+            yield self.value(state_id, t), t
+            t += period
+
+
+class DatasetSource:
+    """Recorded states and histories, shifted so the newest point is 'now'."""
+
+    def __init__(self, path):
+        with open(path) as f:
+            data = json.load(f)
+        self.recorded = data['recorded']
+        self.states = data['states']
+        self.histories = {i: [(v, ts / 1000.0) for v, ts in p] for i, p in data['histories'].items()}
+
+    def shift(self):
+        return Clock.now() - self.recorded
+
+    def is_string(self, state_id):
+        return isinstance(self.states.get(state_id, {}).get('val'), str)
+
+    def state(self, state_id):
+        state = self.states.get(state_id)
+        if state is None:
+            return None
+        shift = int(self.shift() * 1000)
+        return {'val': state['val'], 'ts': state['ts'] + shift, 'lc': state['lc'] + shift}
+
+    def points(self, state_id, start, end, resolution=0):
+        shift = self.shift()
+        for value, t in self.histories.get(state_id, []):
+            if start <= t + shift <= end:
+                yield value, t + shift
+
+
+def aggregate(points, start, end, count, mode):
+    """Aggregation of the history adapter: 'count' buckets between start and end."""
+    step = (end - start) / count
+    buckets = {}
+    for value, t in points:
+        if value is None or isinstance(value, str):
+            continue
+        buckets.setdefault(min(int((t - start) / step), count - 1), []).append((value, t))
+    result = []
+    for index in sorted(buckets):
+        values = [v for v, _ in buckets[index]]
+        middle = start + (index + 0.5) * step
+        if mode == 'minmax':
+            low = min(buckets[index])
+            high = max(buckets[index])
+            result.extend(sorted([low, high], key=lambda p: p[1]))
+        elif mode == 'max':
+            result.append((max(values), middle))
+        elif mode == 'min':
+            result.append((min(values), middle))
+        elif mode == 'total':
+            result.append((sum(values), middle))
+        else:
+            result.append((sum(values) / len(values), middle))
+    return result
+
+
+class Handler(BaseHTTPRequestHandler):
+    """simple-api requests, HTTP/1.1 with keep-alive."""
+    protocol_version = 'HTTP/1.1'
+    source = None
+    options = None
+
+    def log_message(self, fmt, *args):
+        if self.options.verbose:
+            sys.stderr.write('mock: ' + (fmt % args) + '\n')
+
+    def send(self, status, body, content_type='application/json'):
+        data = body.encode()
+        headers = {'Content-Type': content_type + '; charset=utf-8'}
+        if self.options.gzip and 'gzip' in self.headers.get('Accept-Encoding', '') and len(data) > 256:
+            data = gzip.compress(data, 6)
+            headers['Content-Encoding'] = 'gzip'
+        if self.options.latency:
+            time.sleep(self.options.latency / 1000.0)
+        self.send_response(status)
+        for name, value in headers.items():
+            self.send_header(name, value)
+        self.send_header('Content-Length', str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+    def do_GET(self):
+        url = urllib.parse.urlsplit(self.path)
+        query = dict(urllib.parse.parse_qsl(url.query))
+        parts = url.path.split('/', 2)
+        command = parts[1] if len(parts) > 1 else ''
+        argument = urllib.parse.unquote(parts[2]) if len(parts) > 2 else ''
+
+        if command == 'bench' and argument == 'clock':
+            Clock.offset = float(query.get('offset', 0))
+            self.send(200, 'ok', 'text/plain')
+        elif command == 'getPlainValue':
+            state = self.state(argument)
+            if state is None:
+                self.send(404, 'error: datapoint "%s" not found' % argument, 'text/plain')
+            else:
+                self.send(200, json.dumps(state['val']), 'text/plain')
+        elif command == 'get':
+            state = self.state(argument)
+            if state is None:
+                self.send(404, 'error: datapoint "%s" not found' % argument, 'text/plain')
+            else:
+                self.send(200, json.dumps(dict(state, _id=argument, ack=True, q=0, type='state',
+                                               common={'name': argument}, native={})))
+        elif command == 'getBulk':
+            result = []
+            for state_id in argument.split(','):
+                state = self.state(state_id)
+                # like simple-api: an unknown state has only the id
+                result.append({'id': state_id} if state is None else
+                              {'id': state_id, 'val': state['val'], 'ts': state['ts'], 'ack': True})
+            self.send(200, json.dumps(result, separators=(',', ':')))
+        elif command == 'query':
+            self.send(200, self.query(argument, query))
+        else:
+            self.send(404, 'error: unknown command', 'text/plain')
+
+    def state(self, state_id):
+        if state_id in self.options.missing:
+            return None
+        return self.source.state(state_id)
+
+    def query(self, state_id, query):
+        end = parse_date(query['dateTo']) if 'dateTo' in query else Clock.now()
+        start = parse_date(query['dateFrom']) if 'dateFrom' in query else end - DAY
+        count = int(query.get('count', 500))
+        mode = query.get('aggregate', 'none')
+        resolution = 0 if mode == 'none' else (end - start) / max(count, 1) / 10
+        points = [] if state_id in self.options.missing else self.source.points(state_id, start, end, resolution)
+        if mode == 'none':
+            result = []
+            for point in points:
+                if len(result) >= count:
+                    break
+                result.append(point)
+        else:
+            result = aggregate(points, start, end, max(count, 1), mode)
+        datapoints = ','.join('[%s,%d]' % (json.dumps(v), int(t * 1000)) for v, t in result)
+        return '[{"target":%s,"datapoints":[%s]}]' % (json.dumps(state_id), datapoints)
+
+
+MQTT_PREFIX = 'mqtt.0.'
+TASMOTA_PREFIX = 'sonoff.0.TasmotaElite.'
+TASMOTA_TOPIC = 'tele/TasmotaElite/'
+
+
+def topic_matches(topic_filter, topic):
+    """MQTT topic filter with the '+' and '#' wildcards."""
+    filters = topic_filter.split('/')
+    levels = topic.split('/')
+    for index, level in enumerate(filters):
+        if level == '#':
+            return True
+        if index >= len(levels) or (level != '+' and level != levels[index]):
+            return False
+    return len(filters) == len(levels)
+
+
+class MqttHandler(socketserver.BaseRequestHandler):
+    """Broker with the retained messages of the current states, QoS 0 only."""
+    source = None
+    options = None
+    ids = []
+
+    def read_exact(self, size):
+        data = b''
+        while len(data) < size:
+            chunk = self.request.recv(size - len(data))
+            if not chunk:
+                raise ConnectionError('closed')
+            data += chunk
+        return data
+
+    def read_packet(self):
+        header = self.read_exact(1)[0]
+        length = 0
+        for shift in range(0, 28, 7):
+            byte = self.read_exact(1)[0]
+            length |= (byte & 0x7f) << shift
+            if not byte & 0x80:
+                break
+        return header, self.read_exact(length)
+
+    def send_packet(self, header, body):
+        length = len(body)
+        encoded = b''
+        while True:
+            byte = length & 0x7f
+            length >>= 7
+            encoded += bytes([byte | (0x80 if length else 0)])
+            if not length:
+                break
+        self.request.sendall(bytes([header]) + encoded + body)
+
+    def delay(self):
+        if self.options.latency:
+            time.sleep(self.options.latency / 1000.0)
+
+    def retained(self):
+        """Topic and payload of every retained message at the current time."""
+        messages = []
+        energy = {}
+        for state_id in self.ids:
+            state = self.source.state(state_id)
+            if state is None or state_id in self.options.missing:
+                continue
+            value = state['val']
+            text = value if isinstance(value, str) else json.dumps(value)
+            if state_id.startswith(MQTT_PREFIX):
+                messages.append((state_id[len(MQTT_PREFIX):].replace('.', '/'), text))
+            elif state_id.startswith(TASMOTA_PREFIX + 'ENERGY_'):
+                energy[state_id[len(TASMOTA_PREFIX + 'ENERGY_'):]] = value
+            elif state_id == TASMOTA_PREFIX + 'alive':
+                messages.append((TASMOTA_TOPIC + 'LWT', 'Online' if text in ('Online', 'true') else 'Offline'))
+        if energy:
+            now = datetime.fromtimestamp(Clock.now(), timezone.utc).strftime('%Y-%m-%dT%H:%M:%S')
+            messages.append((TASMOTA_TOPIC + 'SENSOR', json.dumps({'Time': now, 'ENERGY': energy}, separators=(',', ':'))))
+        return messages
+
+    def handle(self):
+        # like mosquitto, else the retained messages wait for the delayed acks
+        self.request.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        try:
+            while True:
+                header, body = self.read_packet()
+                kind = header >> 4
+                if kind == 1:  # CONNECT
+                    self.delay()
+                    self.send_packet(0x20, b'\x00\x00')
+                elif kind == 8:  # SUBSCRIBE
+                    packet_id = body[:2]
+                    filters = []
+                    pos = 2
+                    while pos < len(body):
+                        size = struct.unpack('>H', body[pos:pos + 2])[0]
+                        filters.append(body[pos + 2:pos + 2 + size].decode())
+                        pos += 3 + size
+                    self.delay()
+                    self.send_packet(0x90, packet_id + b'\x00' * len(filters))
+                    for topic, payload in self.retained():
+                        if any(topic_matches(f, topic) for f in filters):
+                            name = topic.encode()
+                            self.send_packet(0x31, struct.pack('>H', len(name)) + name + payload.encode())
+                elif kind == 12:  # PINGREQ
+                    self.send_packet(0xd0, b'')
+                elif kind == 14:  # DISCONNECT
+                    break
+        except ConnectionError:
+            pass
+
+
+def serve_mqtt(options, source):
+    """Run the broker in a thread, a synthetic source without ids has no retained messages."""
+    if options.ids:
+        with open(options.ids) as f:
+            MqttHandler.ids = [line.split()[0] for line in f if line.strip()]
+    elif isinstance(source, DatasetSource):
+        MqttHandler.ids = list(source.states)
+    MqttHandler.source = source
+    MqttHandler.options = options
+    socketserver.ThreadingTCPServer.allow_reuse_address = True
+    server = socketserver.ThreadingTCPServer(('127.0.0.1', options.mqtt_port), MqttHandler)
+    server.daemon_threads = True
+    threading.Thread(target=server.serve_forever, name='mqtt', daemon=True).start()
+
+
+class SntpHandler(socketserver.BaseRequestHandler):
+    """SNTP v4 server mode answer (RFC 4330) with the time of the Clock."""
+
+    NTP_UNIX_OFFSET = 2208988800
+
+    @classmethod
+    def timestamp(cls, seconds):
+        seconds += cls.NTP_UNIX_OFFSET
+        return struct.pack('!II', int(seconds), int((seconds % 1) * 2**32) & 0xffffffff)
+
+    def handle(self):
+        data, sock = self.request
+        if len(data) < 48 or data[0] & 0x07 != 3:
+            return
+        received = self.timestamp(Clock.now())
+        # LI 0, VN 4, mode 4 (server), stratum 1, poll of the request, precision 2^-20
+        answer = bytes([0x24, 1, data[2], 0xec]) + bytes(8) + b'BNCH'
+        answer += received + data[40:48] + received + self.timestamp(Clock.now())
+        sock.sendto(answer, self.client_address)
+
+
+def serve_sntp(options):
+    """Run the SNTP server in a thread."""
+    socketserver.ThreadingUDPServer.allow_reuse_address = True
+    server = socketserver.ThreadingUDPServer(('127.0.0.1', options.ntp_port), SntpHandler)
+    server.daemon_threads = True
+    threading.Thread(target=server.serve_forever, name='sntp', daemon=True).start()
+
+
+def record(options):
+    """Read the states and the raw histories of the ids from a real ioBroker."""
+    now = time.time()
+    start = now - options.days * DAY
+    states = {}
+    histories = {}
+
+    def fetch(path):
+        with urllib.request.urlopen(options.source.rstrip('/') + path, timeout=60) as response:
+            return json.loads(response.read().decode())
+
+    with open(options.ids) as f:
+        lines = [line.split() for line in f if line.strip()]
+    for fields in lines:
+        state_id = fields[0]
+        kind = fields[1] if len(fields) > 1 else 'double'
+        quoted = urllib.parse.quote(state_id)
+        if state_id not in states:
+            try:
+                state = fetch('/get/' + quoted)
+                states[state_id] = {'val': state.get('val'), 'ts': state.get('ts', 0), 'lc': state.get('lc', 0)}
+            except Exception as error:
+                print('record: %s failed (%s)' % (state_id, error), file=sys.stderr)
+        if kind in ('history', 'energy') and state_id not in histories:
+            result = fetch('/query/%s?dateFrom=%d&dateTo=%d&count=10000000' % (quoted, start * 1000, now * 1000))
+            histories[state_id] = result[0]['datapoints'] if result else []
+            print('record: %s %d points' % (state_id, len(histories[state_id])), file=sys.stderr)
+    with open(options.out, 'w') as f:
+        json.dump({'recorded': now, 'states': states, 'histories': histories}, f, separators=(',', ':'))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ioBroker stand-in for the host benchmark')
+    parser.add_argument('command', nargs='?', default='serve', choices=['serve', 'record'])
+    parser.add_argument('--port', type=int, default=8087)
+    parser.add_argument('--synthetic', action='store_true', help='serve calculated values')
+    parser.add_argument('--period', type=int, default=60, help='synthetic point period (sec)')
+    parser.add_argument('--dataset', help='serve a recorded dataset')
+    parser.add_argument('--missing', action='append', default=[], help='state id which does not exist')
+    parser.add_argument('--gzip', action='store_true', help='gzip the responses the client accepts')
+    parser.add_argument('--latency', type=float, default=0, help='delay of every response (msec)')
+    parser.add_argument('--verbose', action='store_true', help='log the requests')
+    parser.add_argument('--mqtt-port', type=int, help='serve the states as retained mqtt messages too')
+    parser.add_argument('--ntp-port', type=int, help='answer sntp requests with the clock of the server')
+    parser.add_argument('--clock-offset', type=float, default=0, help='clock of the server ahead of the host (sec)')
+    parser.add_argument('--source', help='record: url of the real ioBroker simple-api')
+    parser.add_argument('--ids', help='record, mqtt: file with the ids (bench --ids)')
+    parser.add_argument('--days', type=int, default=30, help='record: days of the histories')
+    parser.add_argument('--out', default='dataset.json', help='record: dataset file')
+    options = parser.parse_args()
+
+    if options.command == 'record':
+        if not options.source or not options.ids:
+            parser.error('record needs --source and --ids')
+        record(options)
+        return
+    if options.dataset:
+        Handler.source = DatasetSource(options.dataset)
+    elif options.synthetic:
+        Handler.source = SyntheticSource(options.period)
+    else:
+        parser.error('serve needs --synthetic or --dataset')
+    Handler.options = options
+    Clock.offset = options.clock_offset
+    if options.ntp_port:
+        serve_sntp(options)
+    if options.mqtt_port:
+        serve_mqtt(options, Handler.source)
+    server = ThreadingHTTPServer(('127.0.0.1', options.port), Handler)
+    server.daemon_threads = True
+    threading.current_thread().name = 'mock'
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()
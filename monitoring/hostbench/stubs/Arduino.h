@@ -0,0 +1,456 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Arduino.h
+  *
+  * Host (Linux) replacement of the Arduino core parts used by the IoBroker layer
+  * and the ve.direct bridge: String, Serial, millis(), delay(), the pins and the
+  * FreeRTOS task calls of the logger and the health monitor.
+  * The Arduino IDE includes this file implicitly, the Makefile does it with -include.
+  */
+#pragma once
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include "HostClock.h"
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+
+/** Milliseconds since the start of the program, HostClock::millisOffset_ moves them. */
+inline unsigned long millis()
+{
+   static const auto start = std::chrono::steady_clock::now();
+
+   return (unsigned long) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() +
+          HostClock::millisOffset_;
+}
+
+/** Sleep some milliseconds. */
+inline void delay(unsigned long ms)
+{
+   std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+/** Let the other tasks run, nothing to do on the host. */
+inline void yield()
+{
+}
+
+#define OUTPUT 0x03
+#define LOW    0x0
+#define HIGH   0x1
+
+inline void pinMode     (uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+
+/** Start the SNTP client, HostSntp.h has it for the benchmarks which call it. */
+void configTime(long gmtOffset, int daylightOffset, const char *server);
+
+/** Copy with the size of the destination, the libc of the ESP32 has it. */
+inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+   size_t len = strlen(src);
+
+   if (size > 0) {
+      size_t copy = len < size - 1 ? len : size - 1;
+
+      memcpy(dst, src, copy);
+      dst[copy] = '\0';
+   }
+   return len;
+}
+
+#define STRING_SSO_SIZE 11 // Inline buffer of the ESP32 String (sizeof(_ptr) + 4 - 1)
+
+/**
+  * Arduino String with the buffer handling of the ESP32 core (WString), only the members
+  * the firmwares use. Up to 10 chars are stored inline, longer ones on the heap with a
+  * capacity rounded up to 16 bytes, the buffer only grows. So the heap allocations of the
+  * host are the ones of the device.
+  */
+class String
+{
+protected:
+   char        *heap_;                  //!< Heap buffer (NULL = inline)
+   unsigned int capacity_;              //!< Max length in the heap buffer
+   unsigned int length_;                //!< Length without the terminator
+   char         sso_[STRING_SSO_SIZE];  //!< Inline buffer
+
+   char        *wbuffer()        { return heap_ ? heap_ : sso_; }
+   const char  *buffer () const  { return heap_ ? heap_ : sso_; }
+   unsigned int capacity() const { return heap_ ? capacity_ : STRING_SSO_SIZE - 1; }
+
+   void    init  () { heap_ = NULL; capacity_ = 0; length_ = 0; sso_[0] = '\0'; }
+   String &copy  (const char *s, unsigned int len);
+   String &append(const char *s, unsigned int len);
+   void    format(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+public:
+   String()                      { init(); }
+   String(const char *s)         { init(); copy(s ? s : "", s ? strlen(s) : 0); }
+   String(const String &s)       { init(); copy(s.buffer(), s.length_); }
+   String(String &&s);
+   explicit String(char c)       { init(); copy(&c, 1); }
+   explicit String(int v)           { init(); format("%d", v); }
+   explicit String(unsigned int v)  { init(); format("%u", v); }
+   explicit String(long v)          { init(); format("%ld", v); }
+   explicit String(unsigned long v) { init(); format("%lu", v); }
+   explicit String(double v, unsigned int decimals = 2) { init(); format("%.*f", decimals, v); }
+   explicit String(float v, unsigned int decimals = 2)  { init(); format("%.*f", decimals, (double) v); }
+   ~String() { free(heap_); }
+
+   String &operator=(const String &s) { return this == &s ? *this : copy(s.buffer(), s.length_); }
+   String &operator=(const char *s)   { return copy(s ? s : "", s ? strlen(s) : 0); }
+   String &operator=(String &&s);
+
+   unsigned int length() const { return length_; }
+   const char  *c_str () const { return buffer(); }
+   bool         isEmpty() const { return length_ == 0; }
+   bool         reserve(unsigned int size);
+
+   char  operator[](unsigned int i) const { return i < length_ ? buffer()[i] : '\0'; }
+   char &operator[](unsigned int i)       { static char dummy; return i < length_ ? wbuffer()[i] : (dummy = '\0'); }
+   char  charAt    (unsigned int i) const { return (*this)[i]; }
+
+   int indexOf(char c, unsigned int from = 0) const;
+   int indexOf(const String &s, unsigned int from = 0) const;
+   int lastIndexOf(char c) const { const char *p = strrchr(buffer(), c); return p ? (int) (p - buffer()) : -1; }
+
+   String substring(unsigned int from) const { return substring(from, length_); }
+   String substring(unsigned int from, unsigned int to) const;
+
+   long   toInt   () const { return atol(buffer()); }
+   float  toFloat () const { return (float) atof(buffer()); }
+   double toDouble() const { return atof(buffer()); }
+
+   void toLowerCase() { for (char *p = wbuffer(); *p; p++) *p = (char) tolower(*p); }
+   void toUpperCase() { for (char *p = wbuffer(); *p; p++) *p = (char) toupper(*p); }
+   void trim();
+   void replace(const String &from, const String &to);
+   void remove(unsigned int index, unsigned int count = (unsigned int) -1);
+
+   bool startsWith      (const String &s) const { return s.length_ <= length_ && memcmp(buffer(), s.buffer(), s.length_) == 0; }
+   bool endsWith        (const String &s) const { return s.length_ <= length_ && memcmp(buffer() + length_ - s.length_, s.buffer(), s.length_) == 0; }
+   bool equals          (const String &s) const { return length_ == s.length_ && memcmp(buffer(), s.buffer(), length_) == 0; }
+   bool equalsIgnoreCase(const String &s) const { return length_ == s.length_ && strcasecmp(buffer(), s.buffer()) == 0; }
+
+   bool operator==(const String &s) const { return equals(s); }
+   bool operator==(const char *s)   const { return strcmp(buffer(), s ? s : "") == 0; }
+   bool operator!=(const String &s) const { return !equals(s); }
+   bool operator!=(const char *s)   const { return !(*this == s); }
+   bool operator< (const String &s) const { return strcmp(buffer(), s.buffer()) < 0; }
+
+   String &operator+=(const String &s) { return append(s.buffer(), s.length_); }
+   String &operator+=(const char *s)   { return append(s, strlen(s)); }
+   String &operator+=(char c)          { return append(&c, 1); }
+   String &operator+=(int v)           { return *this += String(v); }
+   String &operator+=(unsigned int v)  { return *this += String(v); }
+   String &operator+=(long v)          { return *this += String(v); }
+   String &operator+=(unsigned long v) { return *this += String(v); }
+   String &operator+=(double v)        { return *this += String(v); }
+
+   bool concat(const String &s) { *this += s; return true; }
+   bool concat(char c)          { *this += c; return true; }
+
+   // The ESP32 core adds to one StringSumHelper, the rvalue overloads do the same.
+   template <typename T> friend String operator+(const String &a, const T &b) { String r(a); r += b; return r; }
+   template <typename T> friend String operator+(String &&a, const T &b)      { a += b; return std::move(a); }
+   friend String operator+(const char *a, const String &b) { String r(a); r += b; return r; }
+};
+
+/* Take the buffer of the other string. */
+inline String::String(String &&s)
+{
+   init();
+   *this = std::move(s);
+}
+
+/* Take the buffer of the other string, an inline one is copied. */
+inline String &String::operator=(String &&s)
+{
+   if (this != &s) {
+      if (s.heap_) {
+         free(heap_);
+         heap_     = s.heap_;
+         capacity_ = s.capacity_;
+         length_   = s.length_;
+         s.init();
+      } else {
+         copy(s.sso_, s.length_);
+      }
+   }
+   return *this;
+}
+
+/* Grow the buffer for size chars, the heap capacity is rounded up to 16 bytes. Never shrinks. */
+inline bool String::reserve(unsigned int size)
+{
+   if (size <= capacity()) {
+      return true;
+   }
+
+   unsigned int newSize = (size + 16) & ~0xfU;
+   char        *buffer  = (char *) realloc(heap_, newSize);
+
+   if (!buffer) {
+      return false;
+   }
+   if (!heap_) {
+      memcpy(buffer, sso_, length_ + 1);
+   }
+   heap_     = buffer;
+   capacity_ = newSize - 1;
+   return true;
+}
+
+/* Replace the content. */
+inline String &String::copy(const char *s, unsigned int len)
+{
+   if (reserve(len)) {
+      memmove(wbuffer(), s, len);
+      length_            = len;
+      wbuffer()[length_] = '\0';
+   }
+   return *this;
+}
+
+/* Add to the content, s can be a part of it. */
+inline String &String::append(const char *s, unsigned int len)
+{
+   unsigned int offset = s >= buffer() && s <= buffer() + length_ ? (unsigned int) (s - buffer()) : (unsigned int) -1;
+
+   if (len > 0 && reserve(length_ + len)) {
+      memmove(wbuffer() + length_, offset != (unsigned int) -1 ? buffer() + offset : s, len);
+      length_            += len;
+      wbuffer()[length_]  = '\0';
+   }
+   return *this;
+}
+
+/* Set the formatted number like the itoa()/dtostrf() buffer of the ESP32 core. */
+inline void String::format(const char *format, ...)
+{
+   char    text[48];
+   va_list args;
+
+   va_start(args, format);
+   vsnprintf(text, sizeof(text), format, args);
+   va_end(args);
+   *this = text;
+}
+
+/* Position of the char or -1. */
+inline int String::indexOf(char c, unsigned int from) const
+{
+   const char *p = from < length_ ? strchr(buffer() + from, c) : NULL;
+
+   return p ? (int) (p - buffer()) : -1;
+}
+
+/* Position of the sub string or -1. */
+inline int String::indexOf(const String &s, unsigned int from) const
+{
+   const char *p = from <= length_ ? strstr(buffer() + from, s.buffer()) : NULL;
+
+   return p ? (int) (p - buffer()) : -1;
+}
+
+/* The chars from 'from' up to 'to' (excluded). */
+inline String String::substring(unsigned int from, unsigned int to) const
+{
+   String out;
+
+   if (from > to) {
+      std::swap(from, to);
+   }
+   if (to > length_) {
+      to = length_;
+   }
+   if (from < to) {
+      out.copy(buffer() + from, to - from);
+   }
+   return out;
+}
+
+/* Remove the leading and trailing white spaces. */
+inline void String::trim()
+{
+   char        *text  = wbuffer();
+   unsigned int first = 0;
+   unsigned int last  = length_;
+
+   while (first < last && isspace((unsigned char) text[first])) {
+      first++;
+   }
+   while (last > first && isspace((unsigned char) text[last - 1])) {
+      last--;
+   }
+   length_ = last - first;
+   memmove(text, text + first, length_);
+   text[length_] = '\0';
+}
+
+/* Replace all occurrences of a sub string, in place. */
+inline void String::replace(const String &from, const String &to)
+{
+   String result;
+   int    pos  = 0;
+   int    next;
+
+   if (from.length_ == 0 || indexOf(from) < 0) {
+      return;
+   }
+   if (to.length_ <= from.length_) {
+      char *text = wbuffer();
+      int   len  = 0;
+
+      while ((next = indexOf(from, pos)) >= 0) {
+         memmove(text + len, text + pos, next - pos);
+         len += next - pos;
+         memcpy(text + len, to.buffer(), to.length_);
+         len += to.length_;
+         pos  = next + from.length_;
+      }
+      memmove(text + len, text + pos, length_ - pos);
+      length_       = len + length_ - pos;
+      text[length_] = '\0';
+      return;
+   }
+   while ((next = indexOf(from, pos)) >= 0) {
+      result.append(buffer() + pos, next - pos);
+      result += to;
+      pos = next + from.length_;
+   }
+   result.append(buffer() + pos, length_ - pos);
+   *this = std::move(result);
+}
+
+/* Remove count chars at the index. */
+inline void String::remove(unsigned int index, unsigned int count)
+{
+   if (index < length_) {
+      if (count > length_ - index) {
+         count = length_ - index;
+      }
+      memmove(wbuffer() + index, buffer() + index + count, length_ - index - count + 1);
+      length_ -= count;
+   }
+}
+
+#define SERIAL_8N1          0x800001c
+#define SERIAL_RX_BUFFER    256 // Receive buffer of the ESP32 uart driver
+
+/**
+  * Serial port, the output goes to stdout. The received bytes are put into
+  * the buffer of the uart driver with receive(), bytes which do not fit are lost.
+  */
+class HardwareSerial
+{
+protected:
+   uint8_t rxBuffer_[SERIAL_RX_BUFFER]; //!< Received bytes (ring)
+   size_t  rxHead_ = 0;                 //!< Count of the received bytes
+   size_t  rxTail_ = 0;                 //!< Count of the read bytes
+
+public:
+   void   begin  (unsigned long, uint32_t = SERIAL_8N1, int8_t = -1, int8_t = -1) {}
+   int    available() { return (int) (rxHead_ - rxTail_); }
+   int    read   () { return rxHead_ != rxTail_ ? rxBuffer_[rxTail_++ % SERIAL_RX_BUFFER] : -1; }
+   size_t receive(const uint8_t *data, size_t size);
+   void   flush  () { fflush(stdout); }
+   size_t print  (const String &s) { return fputs(s.c_str(), stdout) < 0 ? 0 : s.length(); }
+   size_t print  (const char *s)   { return fputs(s, stdout) < 0 ? 0 : strlen(s); }
+   size_t println(const String &s) { return print(s) + print("\n"); }
+   size_t println(const char *s)   { return print(s) + print("\n"); }
+   size_t println()                { return print("\n"); }
+   size_t printf (const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+/* Formatted output like printf(). */
+inline size_t HardwareSerial::printf(const char *format, ...)
+{
+   va_list args;
+   int     len;
+
+   va_start(args, format);
+   len = vprintf(format, args);
+   va_end(args);
+   return len < 0 ? 0 : (size_t) len;
+}
+
+/* Put the bytes into the receive buffer. Returns the stored bytes. */
+inline size_t HardwareSerial::receive(const uint8_t *data, size_t size)
+{
+   size_t count = 0;
+
+   while (count < size && rxHead_ - rxTail_ < SERIAL_RX_BUFFER) {
+      rxBuffer_[rxHead_++ % SERIAL_RX_BUFFER] = data[count++];
+   }
+   return count;
+}
+
+inline HardwareSerial Serial;  //!< Console
+inline HardwareSerial Serial1; //!< Second uart
+inline HardwareSerial Serial2; //!< Third uart
+
+/* FreeRTOS: the tasks of the firmware run as detached threads. */
+typedef std::thread *TaskHandle_t;
+
+#define portTICK_PERIOD_MS 1
+
+/* Start a task, it runs until the end of the program. */
+inline int xTaskCreate(void (*task)(void *), const char *, uint32_t, void *param, int, TaskHandle_t *handle)
+{
+   std::thread *thread = new std::thread(task, param);
+
+   thread->detach();
+   if (handle) {
+      *handle = thread;
+   }
+   return 1;
+}
+
+/* Sleep some ticks (1 tick = 1 ms). */
+inline void vTaskDelay(uint32_t ticks)
+{
+   delay(ticks);
+}
+
+/* The main task has no thread object. */
+inline TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+   return NULL;
+}
+
+/* The host stacks are not watched, the size of the ESP32 loop task. */
+inline uint32_t uxTaskGetStackHighWaterMark(TaskHandle_t)
+{
+   return 8192;
+}
@@ -0,0 +1,67 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file FS.h
+  *
+  * Host replacement of the Arduino file class on top of stdio.
+  */
+#pragma once
+#include <stdio.h>
+#include <memory>
+
+#define FILE_READ  "r"
+#define FILE_WRITE "w"
+
+/**
+  * Open file, the copies share the FILE which is closed by the last one or by close().
+  */
+class File
+{
+protected:
+   std::shared_ptr<FILE> file_; //!< stdio file
+
+public:
+   File() {}
+   File(FILE *file) : file_(file, [](FILE *f) { if (f) fclose(f); }) {}
+
+   operator bool() const { return file_ && file_.get(); }
+
+   size_t read (uint8_t *buffer, size_t size)       { return file_ ? fread (buffer, 1, size, file_.get()) : 0; }
+   size_t write(const uint8_t *buffer, size_t size) { return file_ ? fwrite(buffer, 1, size, file_.get()) : 0; }
+   void   close() { file_.reset(); }
+};
+
+/**
+  * File system on a host directory.
+  */
+class FS
+{
+protected:
+   std::string root_; //!< Directory of the files
+
+   std::string path(const String &name) { return root_ + name.c_str(); }
+
+public:
+   FS(const char *root = ".") : root_(root) {}
+
+   void setRoot(const char *root) { root_ = root; }
+
+   File open  (const String &name, const char *mode) { return File(fopen(path(name).c_str(), mode[0] == 'w' ? "wb" : "rb")); }
+   bool exists(const String &name)                   { FILE *f = fopen(path(name).c_str(), "rb"); if (f) fclose(f); return f != NULL; }
+   bool remove(const String &name)                   { return ::remove(path(name).c_str()) == 0; }
+   bool rename(const String &from, const String &to) { return ::rename(path(from).c_str(), path(to).c_str()) == 0; }
+};
@@ -0,0 +1,34 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file HostClock.h
+  *
+  * System time with an offset for the RTC replacements and millis().
+  */
+#pragma once
+#include <time.h>
+
+/**
+  * Host clock, offset_ moves it, e.g. to simulate the time between two wakes.
+  */
+struct HostClock
+{
+   static inline time_t        offset_       = 0; //!< Added to the system time (sec)
+   static inline unsigned long millisOffset_ = 0; //!< Added to millis() (msec)
+
+   static time_t now() { return time(NULL) + offset_; }
+};
@@ -0,0 +1,60 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file HostHeap.h
+  *
+  * Counters of the heap use on the host, the allocation functions of the
+  * benchmark update them. The free size is calculated from a virtual heap
+  * of the size of the ESP32 internal RAM.
+  */
+#pragma once
+#include <atomic>
+#include <stddef.h>
+
+#define HOST_HEAP_SIZE (320 * 1024) // Virtual heap size (bytes)
+
+/**
+  * Allocation counters.
+  */
+struct HostHeap
+{
+   static inline std::atomic<uint64_t> allocations_{0}; //!< Count of malloc/calloc/realloc calls
+   static inline std::atomic<uint64_t> allocated_{0};   //!< Sum of the allocated bytes
+   static inline std::atomic<int64_t>  used_{0};        //!< Currently used bytes
+   static inline std::atomic<int64_t>  maxUsed_{0};     //!< Max used bytes
+
+   /* One block was allocated. */
+   static void onAlloc(size_t size)
+   {
+      int64_t used = used_.fetch_add((int64_t) size) + (int64_t) size;
+      int64_t max  = maxUsed_.load();
+
+      allocations_++;
+      allocated_ += size;
+      while (used > max && !maxUsed_.compare_exchange_weak(max, used)) {
+      }
+   }
+
+   /* One block was freed. */
+   static void onFree(size_t size) { used_ -= (int64_t) size; }
+
+   /* Start a new max used period. */
+   static void resetMax() { maxUsed_ = used_.load(); }
+
+   static size_t getFreeSize       () { int64_t u = used_.load();    return u < HOST_HEAP_SIZE ? (size_t) (HOST_HEAP_SIZE - u) : 0; }
+   static size_t getMinimumFreeSize() { int64_t u = maxUsed_.load(); return u < HOST_HEAP_SIZE ? (size_t) (HOST_HEAP_SIZE - u) : 0; }
+};
@@ -0,0 +1,44 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Inkplate.h
+  *
+  * Host replacement of the Inkplate RTC, it runs on UTC like the device.
+  * HostClock::offset_ moves the clock, e.g. to simulate the time between two wakes.
+  */
+#pragma once
+#include "HostClock.h"
+
+/**
+  * The Inkplate display object, only the RTC.
+  */
+class Inkplate
+{
+protected:
+   struct tm rtc_; //!< Last read RTC value
+
+public:
+   void rtcGetRtcData() { time_t t = HostClock::now(); gmtime_r(&t, &rtc_); }
+   int  rtcGetYear   () { return rtc_.tm_year + 1900 - 2000; }
+   int  rtcGetMonth  () { return rtc_.tm_mon + 1; }
+   int  rtcGetDay    () { return rtc_.tm_mday; }
+   int  rtcGetHour   () { return rtc_.tm_hour; }
+   int  rtcGetMinute () { return rtc_.tm_min; }
+   int  rtcGetSecond () { return rtc_.tm_sec; }
+   void rtcSetTime   (int, int, int) {}
+   void rtcSetDate   (int, int, int, int) {}
+};
@@ -0,0 +1,64 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file M5EPD.h
+  *
+  * Host replacement of the M5Paper RTC, it runs on the local time like the device.
+  * HostClock::offset_ moves the clock, e.g. to simulate the time between two wakes.
+  */
+#pragma once
+#include "HostClock.h"
+
+/** Date of the RTC */
+struct rtc_date_t
+{
+   int8_t  week;
+   int8_t  mon;
+   int8_t  day;
+   int16_t year;
+};
+
+/** Time of the RTC */
+struct rtc_time_t
+{
+   int8_t hour;
+   int8_t min;
+   int8_t sec;
+};
+
+/**
+  * RTC of the M5Paper (BM8563), read only.
+  */
+class BM8563
+{
+public:
+   void getDate(rtc_date_t *date) { time_t t = HostClock::now(); struct tm tm; localtime_r(&t, &tm); date->week = tm.tm_wday; date->mon = tm.tm_mon + 1; date->day = tm.tm_mday; date->year = tm.tm_year + 1900; }
+   void getTime(rtc_time_t *time) { time_t t = HostClock::now(); struct tm tm; localtime_r(&t, &tm); time->hour = tm.tm_hour; time->min = tm.tm_min; time->sec = tm.tm_sec; }
+   void setDate(const rtc_date_t *) {}
+   void setTime(const rtc_time_t *) {}
+};
+
+/**
+  * The M5 device object, only the RTC.
+  */
+class M5EPD
+{
+public:
+   BM8563 RTC; //!< Real time clock
+};
+
+inline M5EPD M5; //!< Device
@@ -0,0 +1,275 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file PubSubClient.h
+  *
+  * Host replacement of the PubSubClient (knolleary, 2.8) MQTT 3.1.1 client, only the
+  * members the firmwares and the bridge use and QoS 0. Like the original, connect() waits for the
+  * CONNACK, subscribe() does not wait for the SUBACK and loop() handles at most one
+  * incoming packet per call.
+  */
+#pragma once
+#include <functional>
+#include <WiFi.h>
+
+#define MQTT_MAX_PACKET_SIZE 256 // Default buffer size
+#define MQTT_KEEPALIVE       15  // Keep alive of the connection (sec)
+#define MQTT_SOCKET_TIMEOUT  15  // Max time to read one packet (sec)
+
+#define MQTTCONNECT     (1 << 4)
+#define MQTTCONNACK     (2 << 4)
+#define MQTTPUBLISH     (3 << 4)
+#define MQTTSUBSCRIBE   (8 << 4)
+#define MQTTPINGREQ     (12 << 4)
+#define MQTTDISCONNECT  (14 << 4)
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char *, uint8_t *, unsigned int)> callback
+
+/**
+  * MQTT client on a WiFiClient.
+  */
+class PubSubClient
+{
+protected:
+   WiFiClient    &client_;     //!< Connection to the broker
+   const char    *domain_;     //!< Host of the broker
+   uint16_t       port_;       //!< Port of the broker
+   uint8_t       *buffer_;     //!< Packet buffer
+   uint16_t       bufferSize_; //!< Size of the packet buffer
+   uint16_t       nextMsgId_;  //!< Id of the next subscribe
+   unsigned long  lastMillis_; //!< Time of the last traffic
+   MQTT_CALLBACK_SIGNATURE;    //!< Receiver of the messages
+
+   bool     readByte  (uint8_t &byte);
+   uint32_t readPacket();
+   bool     write     (uint8_t header, uint32_t length);
+   uint16_t writeString(const char *text, uint16_t pos);
+
+public:
+   PubSubClient(WiFiClient &client)
+      : client_(client)
+      , domain_(NULL)
+      , port_(0)
+      , buffer_((uint8_t *) malloc(MQTT_MAX_PACKET_SIZE))
+      , bufferSize_(MQTT_MAX_PACKET_SIZE)
+      , nextMsgId_(1)
+      , lastMillis_(0)
+   {
+   }
+   ~PubSubClient() { free(buffer_); }
+
+   PubSubClient &setServer    (const char *domain, uint16_t port) { domain_ = domain; port_ = port; return *this; }
+   PubSubClient &setCallback  (MQTT_CALLBACK_SIGNATURE)           { this->callback = callback; return *this; }
+   bool          setBufferSize(uint16_t size);
+
+   bool connect   (const char *id, const char *user, const char *pass);
+   bool subscribe (const char *topic);
+   bool publish   (const char *topic, const uint8_t *payload, unsigned int length, bool retained);
+   bool publish   (const char *topic, const char *payload, bool retained) { return publish(topic, (const uint8_t *) payload, strlen(payload), retained); }
+   bool loop      ();
+   void disconnect();
+   bool connected () { return client_.connected(); }
+   int  state     () { return client_.connected() ? 0 : -1; }
+};
+
+/* Resize the packet buffer. Returns false without memory. */
+inline bool PubSubClient::setBufferSize(uint16_t size)
+{
+   uint8_t *buffer = (uint8_t *) realloc(buffer_, size);
+
+   if (size == 0 || !buffer) {
+      return false;
+   }
+   buffer_     = buffer;
+   bufferSize_ = size;
+   return true;
+}
+
+/* Read one byte, waits up to MQTT_SOCKET_TIMEOUT. */
+inline bool PubSubClient::readByte(uint8_t &byte)
+{
+   unsigned long start = millis();
+
+   while (!client_.available()) {
+      fd_set         readSet;
+      struct timeval tv = { 0, 10000 };
+
+      if (!client_.connected() || millis() - start >= MQTT_SOCKET_TIMEOUT * 1000UL) {
+         return false;
+      }
+      FD_ZERO(&readSet);
+      FD_SET(client_.fd(), &readSet);
+      select(client_.fd() + 1, &readSet, NULL, NULL, &tv);
+   }
+   byte = (uint8_t) client_.read();
+   return true;
+}
+
+/* Read one packet into the buffer, the type byte and the body. A longer one is skipped. Returns its length in the buffer (0 = none). */
+inline uint32_t PubSubClient::readPacket()
+{
+   uint8_t  byte;
+   uint32_t length = 0;
+   uint32_t pos    = 1;
+   int      shift  = 0;
+
+   if (!readByte(buffer_[0])) {
+      return 0;
+   }
+   do {
+      if (shift > 21 || !readByte(byte)) {
+         return 0;
+      }
+      length |= (uint32_t) (byte & 0x7f) << shift;
+      shift  += 7;
+   } while (byte & 0x80);
+   for (uint32_t i = 0; i < length; i++) {
+      if (!readByte(byte)) {
+         return 0;
+      }
+      if (pos < bufferSize_) {
+         buffer_[pos++] = byte;
+      }
+   }
+   lastMillis_ = millis();
+   return length + 1 < bufferSize_ ? pos : 0;
+}
+
+/* Write the packet of the buffer (the body starts at the offset 5) with its fixed header. */
+inline bool PubSubClient::write(uint8_t header, uint32_t length)
+{
+   uint8_t  fixed[5];
+   int      count = 0;
+   uint32_t rest  = length;
+
+   fixed[count++] = header;
+   do {
+      uint8_t byte = rest & 0x7f;
+
+      rest >>= 7;
+      fixed[count++] = byte | (rest > 0 ? 0x80 : 0);
+   } while (rest > 0);
+   memcpy(buffer_ + 5 - count, fixed, count);
+   lastMillis_ = millis();
+   return client_.write(buffer_ + 5 - count, length + count) == length + count;
+}
+
+/* Write the length prefixed string at the position of the buffer. Returns the next position. */
+inline uint16_t PubSubClient::writeString(const char *text, uint16_t pos)
+{
+   uint16_t length = strlen(text);
+
+   buffer_[pos++] = length >> 8;
+   buffer_[pos++] = length & 0xff;
+   memcpy(buffer_ + pos, text, length);
+   return pos + length;
+}
+
+/* Open the connection and wait for the CONNACK. */
+inline bool PubSubClient::connect(const char *id, const char *user, const char *pass)
+{
+   static const uint8_t header[] = { 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04 };
+   uint16_t             pos      = 5;
+   uint8_t              flags    = 0x02; // clean session
+
+   if (!client_.connect(domain_, port_)) {
+      return false;
+   }
+   memcpy(buffer_ + pos, header, sizeof(header));
+   pos += sizeof(header);
+   flags |= user ? 0x80 : 0;
+   flags |= user && pass ? 0x40 : 0;
+   buffer_[pos++] = flags;
+   buffer_[pos++] = MQTT_KEEPALIVE >> 8;
+   buffer_[pos++] = MQTT_KEEPALIVE & 0xff;
+   pos = writeString(id, pos);
+   if (user) {
+      pos = writeString(user, pos);
+      if (pass) {
+         pos = writeString(pass, pos);
+      }
+   }
+   if (!write(MQTTCONNECT, pos - 5) || readPacket() < 3 || (buffer_[0] & 0xf0) != MQTTCONNACK || buffer_[2] != 0) {
+      client_.stop();
+      return false;
+   }
+   return true;
+}
+
+/* Send the subscription, the SUBACK is read by loop(). */
+inline bool PubSubClient::subscribe(const char *topic)
+{
+   uint16_t pos = 5;
+
+   if (!connected() || strlen(topic) + 10 > bufferSize_) {
+      return false;
+   }
+   buffer_[pos++] = nextMsgId_ >> 8;
+   buffer_[pos++] = nextMsgId_ & 0xff;
+   nextMsgId_++;
+   pos = writeString(topic, pos);
+   buffer_[pos++] = 0; // QoS 0
+   return write(MQTTSUBSCRIBE | 0x02, pos - 5);
+}
+
+/* Send one message without a copy of the payload if it fits into the buffer. */
+inline bool PubSubClient::publish(const char *topic, const uint8_t *payload, unsigned int length, bool retained)
+{
+   uint16_t pos = 5;
+
+   if (!connected() || 5 + 2 + strlen(topic) + length > bufferSize_) {
+      return false;
+   }
+   pos = writeString(topic, pos);
+   memcpy(buffer_ + pos, payload, length);
+   return write(MQTTPUBLISH | (retained ? 0x01 : 0x00), pos - 5 + length);
+}
+
+/* Handle one incoming packet and the keep alive. Returns false if the connection is lost. */
+inline bool PubSubClient::loop()
+{
+   if (!connected()) {
+      return false;
+   }
+   if (millis() - lastMillis_ > MQTT_KEEPALIVE * 1000UL) {
+      write(MQTTPINGREQ, 0);
+   }
+   if (client_.available()) {
+      uint32_t length = readPacket();
+
+      if (length > 0 && (buffer_[0] & 0xf0) == MQTTPUBLISH && callback) {
+         uint16_t topicLength = (buffer_[1] << 8) | buffer_[2];
+
+         if (3U + topicLength <= length) {
+            char    *topic   = (char *) buffer_ + 2; // the topic moves one byte down for its terminator
+            uint8_t *payload = buffer_ + 3 + topicLength;
+
+            memmove(topic, topic + 1, topicLength);
+            topic[topicLength] = '\0';
+            callback(topic, payload, length - 3 - topicLength);
+         }
+      }
+   }
+   return true;
+}
+
+/* Send the DISCONNECT and close the connection. */
+inline void PubSubClient::disconnect()
+{
+   write(MQTTDISCONNECT, 0);
+   client_.stop();
+}
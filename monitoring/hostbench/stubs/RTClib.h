@@ -0,0 +1,84 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file RTClib.h
+  *
+  * Host replacement of the RTClib DateTime, seconds since 1970 without a time zone.
+  */
+#pragma once
+#include <time.h>
+
+/**
+  * Time difference in seconds.
+  */
+class TimeSpan
+{
+protected:
+   int32_t seconds_; //!< Length of the span
+
+public:
+   TimeSpan(int32_t seconds = 0) : seconds_(seconds) {}
+
+   int32_t totalseconds() const { return seconds_; }
+};
+
+/**
+  * Date and time, the calendar fields are calculated with gmtime().
+  */
+class DateTime
+{
+protected:
+   uint32_t time_; //!< Seconds since 1970
+
+   struct tm fields() const { time_t t = time_; struct tm tm; gmtime_r(&t, &tm); return tm; }
+
+public:
+   DateTime(uint32_t time = 946684800) : time_(time) {}
+   DateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour = 0, uint8_t minute = 0, uint8_t second = 0)
+   {
+      struct tm tm = {};
+
+      tm.tm_year = year - 1900;
+      tm.tm_mon  = month - 1;
+      tm.tm_mday = day;
+      tm.tm_hour = hour;
+      tm.tm_min  = minute;
+      tm.tm_sec  = second;
+      time_      = (uint32_t) timegm(&tm);
+   }
+
+   uint32_t unixtime     () const { return time_; }
+   uint32_t secondstime  () const { return time_ - 946684800; }
+   uint16_t year         () const { return fields().tm_year + 1900; }
+   uint8_t  month        () const { return fields().tm_mon + 1; }
+   uint8_t  day          () const { return fields().tm_mday; }
+   uint8_t  hour         () const { return fields().tm_hour; }
+   uint8_t  minute       () const { return fields().tm_min; }
+   uint8_t  second       () const { return fields().tm_sec; }
+   uint8_t  dayOfTheWeek () const { return fields().tm_wday; }
+
+   DateTime operator+(const TimeSpan &span) const { return DateTime(time_ + span.totalseconds()); }
+   DateTime operator-(const TimeSpan &span) const { return DateTime(time_ - span.totalseconds()); }
+   TimeSpan operator-(const DateTime &other) const { return TimeSpan((int32_t) (time_ - other.time_)); }
+
+   bool operator< (const DateTime &other) const { return time_ <  other.time_; }
+   bool operator> (const DateTime &other) const { return time_ >  other.time_; }
+   bool operator<=(const DateTime &other) const { return time_ <= other.time_; }
+   bool operator>=(const DateTime &other) const { return time_ >= other.time_; }
+   bool operator==(const DateTime &other) const { return time_ == other.time_; }
+   bool operator!=(const DateTime &other) const { return time_ != other.time_; }
+};
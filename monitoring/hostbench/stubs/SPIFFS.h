@@ -0,0 +1,35 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file SPIFFS.h
+  *
+  * Host replacement of the SPIFFS flash file system, the files are in a host
+  * directory which the benchmark sets with setRoot().
+  */
+#pragma once
+#include "FS.h"
+
+/**
+  * SPIFFS on a host directory.
+  */
+class SPIFFSFS : public FS
+{
+public:
+   bool begin(bool = false) { return true; }
+};
+
+inline SPIFFSFS SPIFFS; //!< Flash file system
@@ -0,0 +1,74 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file TimeLib.h
+  *
+  * Host replacement of the Time library calls of the firmware, all in UTC.
+  */
+#pragma once
+#include <time.h>
+
+/** Calendar fields of the Time library */
+typedef struct {
+   uint8_t Second;
+   uint8_t Minute;
+   uint8_t Hour;
+   uint8_t Wday;  //!< Day of week, sunday is day 1
+   uint8_t Day;
+   uint8_t Month;
+   uint8_t Year;  //!< Offset from 1970
+} tmElements_t;
+
+#define CalendarYrToTm(Y) ((Y) - 1970)
+#define tmYearToCalendar(Y) ((Y) + 1970)
+
+/* Calendar fields to seconds since 1970. */
+inline time_t makeTime(const tmElements_t &tmSet)
+{
+   struct tm tm = {};
+
+   tm.tm_year = tmSet.Year + 70;
+   tm.tm_mon  = tmSet.Month - 1;
+   tm.tm_mday = tmSet.Day;
+   tm.tm_hour = tmSet.Hour;
+   tm.tm_min  = tmSet.Minute;
+   tm.tm_sec  = tmSet.Second;
+   return timegm(&tm);
+}
+
+/* Seconds since 1970 to calendar fields. */
+inline void breakTime(time_t time, tmElements_t &tmSet)
+{
+   struct tm tm;
+
+   gmtime_r(&time, &tm);
+   tmSet.Second = tm.tm_sec;
+   tmSet.Minute = tm.tm_min;
+   tmSet.Hour   = tm.tm_hour;
+   tmSet.Wday   = tm.tm_wday + 1;
+   tmSet.Day    = tm.tm_mday;
+   tmSet.Month  = tm.tm_mon + 1;
+   tmSet.Year   = tm.tm_year - 70;
+}
+
+inline int year   (time_t t) { tmElements_t e; breakTime(t, e); return e.Year + 1970; }
+inline int month  (time_t t) { tmElements_t e; breakTime(t, e); return e.Month; }
+inline int day    (time_t t) { tmElements_t e; breakTime(t, e); return e.Day; }
+inline int weekday(time_t t) { tmElements_t e; breakTime(t, e); return e.Wday; }
+inline int hour   (time_t t) { tmElements_t e; breakTime(t, e); return e.Hour; }
+inline int minute (time_t t) { tmElements_t e; breakTime(t, e); return e.Minute; }
+inline int second (time_t t) { tmElements_t e; breakTime(t, e); return e.Second; }
@@ -0,0 +1,228 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file WiFi.h
+  *
+  * Host replacement of the ESP32 WiFi and WiFiClient on a posix tcp socket.
+  * The static counters hold the traffic of all clients for the benchmark.
+  */
+#pragma once
+#include <netdb.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define WIFI_CLIENT_BUFFER 1436 // Receive buffer, one tcp segment of the ESP32
+
+enum wl_status_t { WL_IDLE_STATUS = 0, WL_CONNECTED = 3, WL_DISCONNECTED = 6 };
+
+/**
+  * Address of the station, always the loopback.
+  */
+struct IPAddress
+{
+   String toString() const { return "127.0.0.1"; }
+};
+
+/**
+  * The station is connected as soon as it begins.
+  */
+class WiFiClass
+{
+protected:
+   wl_status_t status_ = WL_DISCONNECTED; //!< Connection state
+
+public:
+   void        begin    (const char *, const char *) { status_ = WL_CONNECTED; }
+   bool        reconnect() { status_ = WL_CONNECTED; return true; }
+   wl_status_t status   () { return status_; }
+   IPAddress   localIP  () { return IPAddress(); }
+};
+
+inline WiFiClass WiFi; //!< The station
+
+/**
+  * Traffic of all the clients.
+  */
+struct WiFiStatistic
+{
+   static inline uint32_t connects_      = 0; //!< Count of the connects
+   static inline uint32_t requests_      = 0; //!< Count of the written http requests
+   static inline uint64_t sentBytes_     = 0; //!< Written bytes
+   static inline uint64_t receivedBytes_ = 0; //!< Read bytes
+
+   static void reset() { connects_ = 0; requests_ = 0; sentBytes_ = 0; receivedBytes_ = 0; }
+};
+
+/**
+  * Tcp client with the blocking connect and the non blocking byte reads of the ESP32 one.
+  */
+class WiFiClient
+{
+protected:
+   int     fd_;                         //!< Socket (-1 = closed)
+   bool    peerClosed_;                 //!< The server closed the connection
+   uint8_t buffer_[WIFI_CLIENT_BUFFER]; //!< Received bytes
+   int     bufferLen_;                  //!< Count of the bytes in the buffer
+   int     bufferPos_;                  //!< Next byte of the buffer
+
+   bool fill();
+
+public:
+   WiFiClient() : fd_(-1), peerClosed_(false), bufferLen_(0), bufferPos_(0) {}
+   ~WiFiClient() { stop(); }
+
+   int     connect  (const char *host, uint16_t port);
+   uint8_t connected();
+   int     available();
+   int     read     ();
+   size_t  write    (const uint8_t *data, size_t size);
+   size_t  print    (const String &text);
+   void    stop     ();
+   void    flush    () {}
+
+   int           fd        () const { return fd_; }
+   unsigned long getTimeout() const { return 1000; }
+};
+
+/* Open the connection. Returns 1 on success. */
+inline int WiFiClient::connect(const char *host, uint16_t port)
+{
+   struct addrinfo  hints = {};
+   struct addrinfo *result;
+   char             service[8];
+   int              one = 1;
+
+   stop();
+   hints.ai_family   = AF_INET;
+   hints.ai_socktype = SOCK_STREAM;
+   snprintf(service, sizeof(service), "%u", port);
+   if (getaddrinfo(host, service, &hints, &result) != 0) {
+      return 0;
+   }
+   fd_ = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+   if (fd_ >= 0 && ::connect(fd_, result->ai_addr, result->ai_addrlen) != 0) {
+      ::close(fd_);
+      fd_ = -1;
+   }
+   freeaddrinfo(result);
+   if (fd_ < 0) {
+      return 0;
+   }
+   setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+   fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+   peerClosed_ = false;
+   bufferLen_  = 0;
+   bufferPos_  = 0;
+   WiFiStatistic::connects_++;
+   return 1;
+}
+
+/* Read the available bytes into the empty buffer. Returns false if there are none. */
+inline bool WiFiClient::fill()
+{
+   if (bufferPos_ < bufferLen_) {
+      return true;
+   }
+   bufferLen_ = 0;
+   bufferPos_ = 0;
+   if (fd_ < 0 || peerClosed_) {
+      return false;
+   }
+
+   ssize_t len = recv(fd_, buffer_, sizeof(buffer_), 0);
+
+   if (len > 0) {
+      bufferLen_ = (int) len;
+      WiFiStatistic::receivedBytes_ += len;
+      return true;
+   }
+   if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+      peerClosed_ = true;
+   }
+   return false;
+}
+
+/* Open or with unread bytes. */
+inline uint8_t WiFiClient::connected()
+{
+   fill();
+   return fd_ >= 0 && (!peerClosed_ || bufferPos_ < bufferLen_);
+}
+
+/* Count of the buffered bytes. */
+inline int WiFiClient::available()
+{
+   fill();
+   return bufferLen_ - bufferPos_;
+}
+
+/* Next byte or -1. */
+inline int WiFiClient::read()
+{
+   return fill() ? buffer_[bufferPos_++] : -1;
+}
+
+/* Write the bytes. Returns the written bytes. */
+inline size_t WiFiClient::write(const uint8_t *data, size_t size)
+{
+   size_t sent = 0;
+
+   if (fd_ < 0) {
+      return 0;
+   }
+   while (sent < size) {
+      ssize_t len = send(fd_, data + sent, size - sent, MSG_NOSIGNAL);
+
+      if (len > 0) {
+         sent += len;
+      } else if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+         fd_set writeSet;
+
+         FD_ZERO(&writeSet);
+         FD_SET(fd_, &writeSet);
+         select(fd_ + 1, NULL, &writeSet, NULL, NULL);
+      } else {
+         break;
+      }
+   }
+   WiFiStatistic::sentBytes_ += sent;
+   return sent;
+}
+
+/* Write the text, a http request is counted. Returns the written bytes. */
+inline size_t WiFiClient::print(const String &text)
+{
+   if (fd_ >= 0 && text.startsWith("GET ")) {
+      WiFiStatistic::requests_++;
+   }
+   return write((const uint8_t *) text.c_str(), text.length());
+}
+
+/* Close the connection. */
+inline void WiFiClient::stop()
+{
+   if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+   }
+   peerClosed_ = false;
+   bufferLen_  = 0;
+   bufferPos_  = 0;
+}
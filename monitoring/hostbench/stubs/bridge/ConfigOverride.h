@@ -0,0 +1,31 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file ConfigOverride.h
+  *
+  * Configuration of the bridge for the host benchmark (bridge.cpp):
+  * the broker and the SNTP server are the ones of the mock server.
+  */
+#define BENCH_CONFIG_OVERRIDE //!< The bench checks that this file and not the one of the bridge is used
+
+#undef  MQTT_SERVER
+#undef  MQTT_PORT
+#define MQTT_SERVER benchHost
+#define MQTT_PORT   benchMqttPort
+
+#undef  NTP_SERVER
+#define NTP_SERVER  benchNtpServer
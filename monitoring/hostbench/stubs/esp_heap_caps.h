@@ -0,0 +1,30 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file esp_heap_caps.h
+  *
+  * Host replacement of the ESP32 heap statistic.
+  * The values come from the counting allocator of the benchmark (HostHeap.h).
+  */
+#pragma once
+#include "HostHeap.h"
+
+#define MALLOC_CAP_8BIT (1 << 2)
+
+inline size_t heap_caps_get_free_size         (uint32_t) { return HostHeap::getFreeSize(); }
+inline size_t heap_caps_get_minimum_free_size (uint32_t) { return HostHeap::getMinimumFreeSize(); }
+inline size_t heap_caps_get_largest_free_block(uint32_t) { return HostHeap::getFreeSize(); }
@@ -0,0 +1,26 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file esp_system.h
+  *
+  * Host replacement of the ESP32 system heap statistic.
+  */
+#pragma once
+#include "HostHeap.h"
+
+inline uint32_t esp_get_free_heap_size        () { return HostHeap::getFreeSize(); }
+inline uint32_t esp_get_minimum_free_heap_size() { return HostHeap::getMinimumFreeSize(); }
@@ -0,0 +1,63 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file nvs.h
+  *
+  * Host replacement of the ESP32 non volatile storage, the values live in memory only.
+  */
+#pragma once
+#include <map>
+#include <string>
+
+typedef uint32_t nvs_handle;
+typedef int      esp_err_t;
+
+enum nvs_open_mode { NVS_READONLY, NVS_READWRITE };
+
+#define ESP_OK                0
+#define ESP_ERR_NVS_NOT_FOUND 0x1102
+
+/* The stored values by key. */
+inline std::map<std::string, uint16_t> &nvsValues()
+{
+   static std::map<std::string, uint16_t> values;
+
+   return values;
+}
+
+inline esp_err_t nvs_open  (const char *, nvs_open_mode, nvs_handle *handle) { *handle = 1; return ESP_OK; }
+inline esp_err_t nvs_commit(nvs_handle) { return ESP_OK; }
+inline void      nvs_close (nvs_handle) {}
+
+/* Read a value, it is not changed if the key is unknown. */
+inline esp_err_t nvs_get_u16(nvs_handle, const char *key, uint16_t *value)
+{
+   auto it = nvsValues().find(key);
+
+   if (it == nvsValues().end()) {
+      return ESP_ERR_NVS_NOT_FOUND;
+   }
+   *value = it->second;
+   return ESP_OK;
+}
+
+/* Write a value. */
+inline esp_err_t nvs_set_u16(nvs_handle, const char *key, uint16_t value)
+{
+   nvsValues()[key] = value;
+   return ESP_OK;
+}
@@ -0,0 +1,107 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file miniz.h
+  *
+  * Host replacement of the tinfl inflater of the ESP32 ROM on top of zlib.
+  * zlib gets its memory from an arena in the decompressor, so a free() of the
+  * decompressor releases everything like with tinfl.
+  */
+#pragma once
+#include <zlib.h>
+
+#define TINFL_LZ_DICT_SIZE 32768
+#define TINFL_ARENA_SIZE   (48 * 1024) // inflate state and the 32k window of zlib
+
+enum
+{
+   TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+   TINFL_FLAG_HAS_MORE_INPUT    = 2
+};
+
+typedef enum
+{
+   TINFL_STATUS_BAD_PARAM         = -3,
+   TINFL_STATUS_ADLER32_MISMATCH  = -2,
+   TINFL_STATUS_FAILED            = -1,
+   TINFL_STATUS_DONE              = 0,
+   TINFL_STATUS_NEEDS_MORE_INPUT  = 1,
+   TINFL_STATUS_HAS_MORE_OUTPUT   = 2
+} tinfl_status;
+
+/** Decompressor with the zlib stream and its memory */
+typedef struct
+{
+   bool     started;                 //!< inflateInit2() was called
+   size_t   used;                    //!< Used bytes of the arena
+   z_stream stream;                  //!< zlib stream
+   uint8_t  arena[TINFL_ARENA_SIZE]; //!< Memory of zlib
+} tinfl_decompressor;
+
+#define tinfl_init(r) do { (r)->started = false; (r)->used = 0; } while (0)
+
+/* zlib allocation from the arena, freed with the decompressor. */
+inline voidpf tinfl_arena_alloc(voidpf opaque, uInt items, uInt size)
+{
+   tinfl_decompressor *r     = (tinfl_decompressor *) opaque;
+   size_t              bytes = ((size_t) items * size + 15) & ~(size_t) 15;
+
+   if (r->used + bytes > TINFL_ARENA_SIZE) {
+      return Z_NULL;
+   }
+   r->used += bytes;
+   return r->arena + r->used - bytes;
+}
+
+/* zlib free, the arena is released as a whole. */
+inline void tinfl_arena_free(voidpf, voidpf) {}
+
+/* Inflate the input into the output ring buffer, the sizes are updated to the processed bytes. */
+inline tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size,
+                                     uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size,
+                                     const uint32_t decomp_flags)
+{
+   int ret;
+
+   (void) pOut_buf_start;
+   if (!r->started) {
+      memset(&r->stream, 0, sizeof(r->stream));
+      r->stream.zalloc = tinfl_arena_alloc;
+      r->stream.zfree  = tinfl_arena_free;
+      r->stream.opaque = r;
+      if (inflateInit2(&r->stream, (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) ? 15 : -15) != Z_OK) {
+         return TINFL_STATUS_BAD_PARAM;
+      }
+      r->started = true;
+   }
+   r->stream.next_in   = (Bytef *) pIn_buf_next;
+   r->stream.avail_in  = (uInt) *pIn_buf_size;
+   r->stream.next_out  = pOut_buf_next;
+   r->stream.avail_out = (uInt) *pOut_buf_size;
+
+   ret = inflate(&r->stream, Z_SYNC_FLUSH);
+
+   *pIn_buf_size  -= r->stream.avail_in;
+   *pOut_buf_size -= r->stream.avail_out;
+   if (ret == Z_STREAM_END) {
+      return TINFL_STATUS_DONE;
+   }
+   if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      return TINFL_STATUS_FAILED;
+   }
+   return r->stream.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
@@ -180,7 +180,7 @@ void SolarDisplay::DrawGraph(int x, int y, int dx, int dy, HistoryData &powerHis
       
       display.setTextSize(1);
       for (int i = 0; i < powerHistory.size_; i++) {
-         DateTime date = powerHistory.dates_[i];
+         DateTime date = powerHistory.getDate(i);
          String   day  = String(date.day());
          
          if (oldDay != day && date.hour() >= 12) {
@@ -198,7 +198,7 @@ void SolarDisplay::DrawGraph(int x, int y, int dx, int dy, HistoryData &powerHis
       float yStep = (float) graphDY / (float) powerHistory.getMax();
       
       for (int i = 0; i < powerHistory.size_; i++) {
-         float yValue   = powerHistory.values_[i];
+         float yValue   = powerHistory.getValue(i);
          float yValueDY = (float) graphDY / (float) powerHistory.getMax();
          float xPos     = (float) graphX + graphDX / (float) powerHistory.size_ * i;
          float yPos     = (float) graphY + graphDY - (float) (yValue) * yValueDY;
@@ -207,7 +207,17 @@ void SolarDisplay::DrawGraph(int x, int y, int dx, int dy, HistoryData &powerHis
          if (yPos < graphY)           yPos = graphY;
    
          if (i > 0) {
-            display.drawLine(xPos, graphY + graphDY, xPos, yPos, GRAY_0);
+            if (powerHistory.isBand()) {
+               // Band history: light up to the highest, dark up to the lowest value of the bucket.
+               float yLow = (float) graphY + graphDY - powerHistory.getLow(i) * yValueDY;
+
+               if (yLow > graphY + graphDY) yLow = graphY + graphDY;
+               if (yLow < yPos)             yLow = yPos;
+               display.drawLine(xPos, yLow, xPos, yPos, GRAY_4);
+               display.drawLine(xPos, graphY + graphDY, xPos, yLow, GRAY_0);
+            } else {
+               display.drawLine(xPos, graphY + graphDY, xPos, yPos, GRAY_0);
+            }
             // Serial.printf("GraphLine: %d %f %d, %d\n", i, yValue, (int) xPos, (int) yPos);
          }
       }
@@ -219,7 +229,7 @@ void SolarDisplay::DrawGraph(int x, int y, int dx, int dy, HistoryData &powerHis
       int   yLast = 0;
       
       for (int i = 0; i < chargeHistory->size_; i++) {
-         float yValue   = chargeHistory->values_[i];
+         float yValue   = chargeHistory->getValue(i);
          float yValueDY = (float) graphDY / (float) 1000.0;
          float xPos     = (float) graphX + graphDX / (float) chargeHistory->size_ * i;
          float yPos     = (float) graphY + graphDY - (float) (yValue) * yValueDY;
@@ -248,9 +258,9 @@ void SolarDisplay::DrawGraph(int x, int y, int dx, int dy, HistoryData &powerHis
       float  yMaxValue = 0.0;
 
       for (int i = 0; i < yieldHistory.size_; i++) {
-         DateTime date   = yieldHistory.dates_[i];
+         DateTime date   = yieldHistory.getDate(i);
          String   day    = String(date.day());
-         float    yValue = yieldHistory.values_[i];
+         float    yValue = yieldHistory.getValue(i);
          float    xPos   = graphX - 3 + i * xStep;
 
          if (yValue > yMaxValue) {
@@ -377,6 +387,12 @@ void SolarDisplay::DrawHeadVersion(int x, int y)
 void SolarDisplay::DrawHeadUpdated(int x, int y)
 {
    String updatedString = "Updated " + getDateTimeString(GetRTCTime());
+
+   if (myData.cachedTime > 0) {
+      updatedString = "Offline, data of " + getDateTimeString(myData.cachedTime);
+   } else if (myData.IsStale()) {
+      updatedString += " (partly cached)";
+   }
    
    DrawCentreString(updatedString, x, y);
 }
@@ -657,7 +673,7 @@ void SolarDisplay::DrawBody(int x, int y, int dx, int dy)
 /* Fill the screen. */
 void SolarDisplay::Show()
 {
-   Serial.println("SolarDisplay::DrawSolarInfo");
+   LOG_DEBUG("SolarDisplay::DrawSolarInfo");
 
    display.setTextSize(2);
    display.setTextColor(0, 7);
@@ -672,7 +688,7 @@ void SolarDisplay::Show()
 /* Show WiFi connewction error. */
 void SolarDisplay::ShowWiFiError(String ssid)
 {
-   Serial.println("SolarDisplay::ShowWiFiError");
+   LOG_DEBUG("SolarDisplay::ShowWiFiError");
 
    display.setTextSize(4);
    display.setTextColor(0, 7);
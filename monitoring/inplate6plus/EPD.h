@@ -25,7 +25,7 @@
 /* Initialize the M5Paper */
 void InitEPD(bool clearDisplay = true)
 {
-   Serial.println("Init");
+   LOG_DEBUG("Init");
    
    display.begin();
 
@@ -47,7 +47,8 @@ void InitEPD(bool clearDisplay = true)
 */
 void ShutdownEPD(int sec)
 {
-   Serial.println("Shutdown (" + String((int) (sec / 60)) + " min)");
+   LOG_INFO("Shutdown (%d min)", (int) (sec / 60));
+   logger.flush(LOG_FLUSH_TIMEOUT);
 
    display.tsShutdown();                            // Turn off the display touchscreen
    display.frontlight(0);                           // Turn off the frontlight
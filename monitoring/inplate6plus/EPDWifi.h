@@ -25,20 +25,18 @@
 /* Connect to wifi */
 bool ConnectToWifi(String ssid, String pw) 
 {
-   Serial.print("Connecting to ");
-   Serial.println(ssid);
+   LOG_INFO("Connecting to %s", ssid.c_str());
    delay(100);
    
    WiFi.begin(ssid.c_str(), pw.c_str());
    for (int retry = 0; WiFi.status() != WL_CONNECTED && retry < 30; retry++) {
       delay(500);
-      Serial.print(".");
    }
    if (WiFi.status() == WL_CONNECTED) {
-      Serial.println("\nWiFi connected at: " + WiFi.localIP().toString());
+      LOG_INFO("WiFi connected at: %s", WiFi.localIP().toString().c_str());
       return true;
    } else {
-      Serial.println("\nWiFi connection *** FAILED ***");
+      LOG_ERROR("WiFi connection *** FAILED ***");
       return false;
    }
 }
@@ -65,7 +63,7 @@ bool StartWiFi(int &rssi)
 /* Stop the wifi connection */
 void StopWiFi() 
 {
-   Serial.println("Stop WiFi");
+   LOG_DEBUG("Stop WiFi");
    WiFi.disconnect();
    WiFi.mode(WIFI_OFF);
 }
@@ -0,0 +1,171 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Health.h
+  *
+  * Heap and stack health telemetry.
+  * Samples the free heap, the largest free block (fragmentation), the minimum
+  * free heap since boot, the stack high water marks of the registered tasks
+  * and the loop jitter and formats them as a compact json document.
+  * The loop values are only reported if loopTick() measured a loop, a
+  * firmware which runs once per wake has none.
+  */
+#pragma once
+#include <esp_heap_caps.h>
+#include <esp_system.h>
+
+#ifndef HEALTH_ALERT_MIN_FREE_HEAP
+  #define HEALTH_ALERT_MIN_FREE_HEAP   20000 //!< Alert if the min free heap drops below (bytes)
+#endif
+#ifndef HEALTH_ALERT_FRAGMENTATION
+  #define HEALTH_ALERT_FRAGMENTATION   60    //!< Alert if the heap fragmentation is higher (%)
+#endif
+
+#define HEALTH_MAX_TASKS 4 //!< Max count of watched tasks
+
+/**
+  * Collects the heap, stack and loop timing values.
+  */
+class HealthMonitor
+{
+public:
+   uint32_t     freeHeap_;                           //!< Current free heap (bytes)
+   uint32_t     largestFreeBlock_;                   //!< Largest allocatable block (bytes)
+   uint32_t     minFreeHeap_;                        //!< Minimum free heap since boot (bytes)
+   int          fragmentation_;                      //!< 100 - largest block / free heap (%)
+   uint32_t     loopMaxMillis_;                      //!< Longest loop of the last sample period
+   uint32_t     loopJitterMillis_;                   //!< Longest - shortest loop of the last sample period
+   bool         loopMeasured_;                       //!< The last sample period has a complete loop
+
+protected:
+   const char  *taskNames_[HEALTH_MAX_TASKS];        //!< Names of the watched tasks
+   TaskHandle_t taskHandles_[HEALTH_MAX_TASKS];      //!< Handles of the watched tasks
+   uint32_t     taskStacks_[HEALTH_MAX_TASKS];       //!< Stack high water mark of the tasks
+   int          taskCount_;                          //!< Count of the watched tasks
+
+   uint32_t     lastLoopMillis_;                     //!< Start of the last loop
+   uint32_t     periodMaxMillis_;                    //!< Longest loop since the last sample
+   uint32_t     periodMinMillis_;                    //!< Shortest loop since the last sample
+
+public:
+   HealthMonitor();
+
+   bool addTask(const char *name, TaskHandle_t handle = NULL);
+   void loopTick();
+   void sample();
+   bool isAlert();
+   int  toJson(char *buffer, int size);
+};
+
+/* ******************************************** */
+
+HealthMonitor::HealthMonitor()
+   : freeHeap_(0)
+   , largestFreeBlock_(0)
+   , minFreeHeap_(0)
+   , fragmentation_(0)
+   , loopMaxMillis_(0)
+   , loopJitterMillis_(0)
+   , loopMeasured_(false)
+   , taskCount_(0)
+   , lastLoopMillis_(0)
+   , periodMaxMillis_(0)
+   , periodMinMillis_(UINT32_MAX)
+{
+}
+
+/** Watch the stack of a task. NULL is the calling task. */
+bool HealthMonitor::addTask(const char *name, TaskHandle_t handle /*= NULL*/)
+{
+   if (taskCount_ >= HEALTH_MAX_TASKS) {
+      return false;
+   }
+   taskNames_[taskCount_]   = name;
+   taskHandles_[taskCount_] = handle ? handle : xTaskGetCurrentTaskHandle();
+   taskStacks_[taskCount_]  = 0;
+   taskCount_++;
+   return true;
+}
+
+/** Call this at the start of every loop to measure the loop jitter. */
+void HealthMonitor::loopTick()
+{
+   uint32_t now = millis();
+
+   if (lastLoopMillis_ != 0) {
+      uint32_t duration = now - lastLoopMillis_;
+
+      if (duration > periodMaxMillis_) {
+         periodMaxMillis_ = duration;
+      }
+      if (duration < periodMinMillis_) {
+         periodMinMillis_ = duration;
+      }
+   }
+   lastLoopMillis_ = now;
+}
+
+/** Read all the current values and start a new loop statistic period. */
+void HealthMonitor::sample()
+{
+   freeHeap_         = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+   largestFreeBlock_ = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+   minFreeHeap_      = esp_get_minimum_free_heap_size();
+   fragmentation_    = freeHeap_ > 0 ? 100 - (int) (100ULL * largestFreeBlock_ / freeHeap_) : 0;
+
+   for (int i = 0; i < taskCount_; i++) {
+      taskStacks_[i] = uxTaskGetStackHighWaterMark(taskHandles_[i]);
+   }
+
+   loopMeasured_     = periodMinMillis_ <= periodMaxMillis_;
+   loopMaxMillis_    = periodMaxMillis_;
+   loopJitterMillis_ = periodMinMillis_ <= periodMaxMillis_ ? periodMaxMillis_ - periodMinMillis_ : 0;
+   periodMaxMillis_  = 0;
+   periodMinMillis_  = UINT32_MAX;
+}
+
+/** Is one of the alert thresholds reached? */
+bool HealthMonitor::isAlert()
+{
+   return minFreeHeap_   < HEALTH_ALERT_MIN_FREE_HEAP ||
+          fragmentation_ > HEALTH_ALERT_FRAGMENTATION;
+}
+
+/** Format the last sample as compact json, "loop" and "jitter" only if a loop was measured.
+  * {"heap":123,"block":456,"minHeap":789,"frag":12,"loop":10,"jitter":2,"stack":{"loop":1234},"alert":0}
+  * Returns the length of the document.
+  */
+int HealthMonitor::toJson(char *buffer, int size)
+{
+   int len = snprintf(buffer, size, "{\"heap\":%u,\"block\":%u,\"minHeap\":%u,\"frag\":%d,",
+                      freeHeap_, largestFreeBlock_, minFreeHeap_, fragmentation_);
+
+   if (loopMeasured_ && len < size) {
+      len += snprintf(buffer + len, size - len, "\"loop\":%u,\"jitter\":%u,", loopMaxMillis_, loopJitterMillis_);
+   }
+   if (len < size) {
+      len += snprintf(buffer + len, size - len, "\"stack\":{");
+   }
+
+   for (int i = 0; i < taskCount_ && len < size; i++) {
+      len += snprintf(buffer + len, size - len, "%s\"%s\":%u", i > 0 ? "," : "", taskNames_[i], taskStacks_[i]);
+   }
+   if (len < size) {
+      len += snprintf(buffer + len, size - len, "},\"alert\":%d}", isAlert() ? 1 : 0);
+   }
+   return len < size ? len : size - 1;
+}
@@ -0,0 +1,200 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Log.h
+  *
+  * Asynchronous logging with compile time log levels.
+  * The messages are formatted into a lock free ring buffer and written
+  * to the serial console by a low priority task, so the main loop never
+  * waits for the slow serial line.
+  * Disabled log levels are removed by the preprocessor and cost nothing.
+  */
+#pragma once
+#include <atomic>
+#include <stdarg.h>
+
+#define LOG_LEVEL_NONE     0
+#define LOG_LEVEL_ERROR    1
+#define LOG_LEVEL_INFO     2
+#define LOG_LEVEL_DEBUG    3
+
+#ifndef LOG_LEVEL
+  #define LOG_LEVEL        LOG_LEVEL_INFO
+#endif
+
+#define LOG_SLOT_COUNT     32   //!< Number of messages in the ring buffer (power of 2)
+#ifndef LOG_SLOT_SIZE
+  #define LOG_SLOT_SIZE    96   //!< Max length of one message
+#endif
+#define LOG_TASK_PRIORITY  1    //!< Priority of the drain task (loop runs with 1 too)
+#define LOG_TASK_STACK     2048 //!< Stack size of the drain task
+#define LOG_DRAIN_MILLIS   20   //!< Sleep time of the drain task if the buffer is empty
+#define LOG_FLUSH_TIMEOUT  1000 //!< Max wait for the drain task before a deep sleep (msec)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+  #define LOG_ERROR(...) logger.printf(__VA_ARGS__)
+#else
+  #define LOG_ERROR(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+  #define LOG_INFO(...)  logger.printf(__VA_ARGS__)
+#else
+  #define LOG_INFO(...)  do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+  #define LOG_DEBUG(...) logger.printf(__VA_ARGS__)
+#else
+  #define LOG_DEBUG(...) do {} while (0)
+#endif
+
+/**
+  * Multi producer, single consumer ring buffer logger.
+  * Every message reserves one slot with a compare and swap on the head index.
+  * If the buffer is full the message is dropped and counted.
+  */
+class Logger
+{
+protected:
+   struct Slot
+   {
+      std::atomic<bool> ready;                //!< Slot is completely formatted
+      char              text[LOG_SLOT_SIZE];  //!< Formatted message
+   };
+
+   Slot                  slots_[LOG_SLOT_COUNT]; //!< The ring buffer
+   std::atomic<uint32_t> head_;                  //!< Next slot to write
+   std::atomic<uint32_t> tail_;                  //!< Next slot to drain
+   std::atomic<uint32_t> dropped_;               //!< Count of dropped messages
+   TaskHandle_t          task_;                  //!< Drain task
+
+protected:
+   static void drainTask(void *param);
+
+public:
+   Logger();
+
+   void         begin();
+   void         printf(const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
+   bool         drain();
+   void         flush(unsigned long timeout);
+   uint32_t     getDropped();
+   TaskHandle_t getTask();
+};
+
+Logger logger; //!< The global logger
+
+/* ******************************************** */
+
+Logger::Logger()
+   : head_(0)
+   , tail_(0)
+   , dropped_(0)
+   , task_(NULL)
+{
+   for (int i = 0; i < LOG_SLOT_COUNT; i++) {
+      slots_[i].ready = false;
+   }
+}
+
+/** Start the low priority task which writes the messages to the serial port. */
+void Logger::begin()
+{
+   if (!task_) {
+      xTaskCreate(drainTask, "log", LOG_TASK_STACK, this, LOG_TASK_PRIORITY, &task_);
+   }
+}
+
+/** Format one message into the next free slot. */
+void Logger::printf(const char *fmt, ...)
+{
+   uint32_t head = head_.load(std::memory_order_relaxed);
+
+   do {
+      if (head - tail_.load(std::memory_order_acquire) >= LOG_SLOT_COUNT) {
+         dropped_.fetch_add(1, std::memory_order_relaxed);
+         return;
+      }
+   } while (!head_.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel));
+
+   Slot   &slot = slots_[head & (LOG_SLOT_COUNT - 1)];
+   va_list args;
+
+   va_start(args, fmt);
+   vsnprintf(slot.text, LOG_SLOT_SIZE, fmt, args);
+   va_end(args);
+   slot.ready.store(true, std::memory_order_release);
+}
+
+/** Write all completed messages to the serial port.
+  * Returns false if nothing was written.
+  */
+bool Logger::drain()
+{
+   uint32_t tail    = tail_.load(std::memory_order_relaxed);
+   bool     written = false;
+
+   while (tail != head_.load(std::memory_order_acquire)) {
+      Slot &slot = slots_[tail & (LOG_SLOT_COUNT - 1)];
+
+      // The producer reserved the slot but is still formatting.
+      if (!slot.ready.load(std::memory_order_acquire)) {
+         break;
+      }
+      Serial.println(slot.text);
+      slot.ready.store(false, std::memory_order_relaxed);
+      tail_.store(++tail, std::memory_order_release);
+      written = true;
+   }
+   return written;
+}
+
+/** Wait until the drain task has written all messages, e.g. before a deep sleep. */
+void Logger::flush(unsigned long timeout)
+{
+   unsigned long start = millis();
+
+   while (task_ && tail_.load(std::memory_order_acquire) != head_.load(std::memory_order_acquire) &&
+          millis() - start < timeout) {
+      vTaskDelay(LOG_DRAIN_MILLIS / portTICK_PERIOD_MS);
+   }
+}
+
+/** Count of the messages lost because of a full buffer. */
+uint32_t Logger::getDropped()
+{
+   return dropped_.load(std::memory_order_relaxed);
+}
+
+/** Handle of the drain task (NULL before begin()). */
+TaskHandle_t Logger::getTask()
+{
+   return task_;
+}
+
+/** Task function: drain the buffer, sleep if there is nothing to do. */
+void Logger::drainTask(void *param)
+{
+   Logger *logger = (Logger *) param;
+
+   for (;;) {
+      if (!logger->drain()) {
+         vTaskDelay(LOG_DRAIN_MILLIS / portTICK_PERIOD_MS);
+      }
+   }
+}
@@ -25,28 +25,24 @@
 /* Set the internal RTC clock with the weather timestamp */
 void UpdateRTCFromNTP()
 {
-   Serial.println("Update RTC from NTP.");
+   LOG_DEBUG("Update RTC from NTP.");
    
    configTime(0, 3600, "pool.ntp.org");
    setenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);
    tzset();
 
-   Serial.print(F("Waiting for NTP time sync: "));
    time_t nowSecs = time(nullptr);
    while (nowSecs < 8 * 3600 * 2) {
       delay(500);
-      Serial.print(F("."));
       yield();
       nowSecs = time(nullptr);
    }
-   Serial.println(" -> ok");
    
    // Used to store time info
    struct tm timeinfo;
    gmtime_r(&nowSecs, &timeinfo);
    
-   Serial.print(F("Current time: "));
-   Serial.print(asctime(&timeinfo));    
+   LOG_INFO("NTP time: %s", asctime(&timeinfo));
 
    display.rtcReset();
    display.rtcSetDate(0, timeinfo.tm_mday, timeinfo.tm_mon + 1, timeinfo.tm_year + 1900 - 2000);
@@ -65,8 +65,8 @@ time_t UtcToLocalTime(time_t utcTime)
    if (tm) {
       tmElements_t tmSet;
 
-      tmSet.Year   = tm->tm_year + 70;
-      tmSet.Month  = tm->tm_mon;
+      tmSet.Year   = tm->tm_year + 1900 - 1970;
+      tmSet.Month  = tm->tm_mon + 1;
       tmSet.Day    = tm->tm_mday;
       tmSet.Hour   = tm->tm_hour;
       tmSet.Minute = tm->tm_min;
@@ -74,7 +74,7 @@ time_t UtcToLocalTime(time_t utcTime)
   
       return makeTime(tmSet);
    }
-   Serial.println("!!! Error on UtcToLocalTime() !!!");
+   LOG_ERROR("!!! Error on UtcToLocalTime() !!!");
    return utcTime;
 }
 
@@ -39,7 +39,7 @@ bool GetBatteryValues(MyData &myData)
    float battery = (float)(vol - 3400) / (float)(4100 - 3400);
 
    myData.batteryVolt = vol / 1000.0f;
-   Serial.println("batteryVolt: " + String(myData.batteryVolt));
+   LOG_DEBUG("batteryVolt: %f", myData.batteryVolt);
    
    if (battery <= 0.01) {
       battery = 0.01;
@@ -48,7 +48,7 @@ bool GetBatteryValues(MyData &myData)
       battery = 1;
    }
    myData.batteryCapacity = (int) (battery * 100);
-   Serial.println("batteryCapacity: " + String(myData.batteryCapacity));
+   LOG_DEBUG("batteryCapacity: %d", myData.batteryCapacity);
    
    return true;
 }
@@ -28,3 +28,19 @@
 
 #define IOBROKER_URL     "iobroker.url"
 #define IOBROKER_PORT    8087
+
+#define DATA_SOURCE_IOBROKER 0 // Current values with http from the IoBroker
+#define DATA_SOURCE_MQTT     1 // Current values from the retained mqtt messages, the histories from the IoBroker
+#define DATA_SOURCE      DATA_SOURCE_IOBROKER
+
+#define MQTT_NAME        "M5PaperSolarMonitor"
+#define MQTT_SERVER      "mqtt.url"
+#define MQTT_PORT        1883
+#define MQTT_USER        "user"
+#define MQTT_PASSWORD    "password"
+
+#define LOG_LEVEL        LOG_LEVEL_INFO // LOG_LEVEL_NONE, LOG_LEVEL_ERROR, LOG_LEVEL_INFO or LOG_LEVEL_DEBUG
+#define LOG_SLOT_SIZE    192            // Max length of one log message, the history urls are long
+
+#define TASMOTA_SENSOR_TOPIC "tele/TasmotaElite/SENSOR" // Retained with the Tasmota command 'SensorRetain 1'
+#define TASMOTA_LWT_TOPIC    "tele/TasmotaElite/LWT"
@@ -72,7 +72,7 @@ public:
       , mainVoltage(0.0)
       , alarmReason(0.0)
       , lastChange(EmptyDateTime)
-      , chargeHistory(CHARGE_HISTORY_SIZE, "%")
+      , chargeHistory(CHARGE_HISTORY_SIZE, "%", 0.1)
    {}
    
    void Dump();
@@ -98,7 +98,7 @@ public:
    DateTime    lastChange;            //!< Last change of the data
 
    HistoryData ppvHistory;            //!< Panel power history
-   HistoryData yieldHistory;          //!< Yield history
+   HistoryData yieldHistory;          //!< Yield per day, integrated from the panel power
    
 public:
    MPPT()
@@ -114,8 +114,8 @@ public:
       , panelVoltage(0.0)
       , errorCode(0.0)
       , lastChange(EmptyDateTime)
-      , ppvHistory(PPV_HISTORY_SIZE, "W")
-      , yieldHistory(PPV_HISTORY_SIZE, "kWh")
+      , ppvHistory(PPV_HISTORY_SIZE, "W", 0.1, true)
+      , yieldHistory(PPV_HISTORY_SIZE, "kWh", 0.001)
    {
    }
 
@@ -135,7 +135,7 @@ public:
    String      alive;        //!< Switched on or off
 
    HistoryData powerHistory; //!< Grid power history
-   HistoryData yieldHistory; //!< Grid power history
+   HistoryData yieldHistory; //!< Grid energy per day, integrated from the grid power
 
 public:
    TasmotaElite()
@@ -143,14 +143,29 @@ public:
       , ampere(0.0)
       , power(0.0)
       , lastChange(EmptyDateTime)
-      , powerHistory(GRID_HISTORY_SIZE, "W")
-      , yieldHistory(GRID_HISTORY_SIZE, "kWh")
+      , powerHistory(GRID_HISTORY_SIZE, "W", 1.0)
+      , yieldHistory(GRID_HISTORY_SIZE, "kWh", 0.001)
    {
    }
 
    void Dump();
 };
 
+/**
+  * Energy per hour and per day, integrated on the device from the power histories.
+  */
+class EnergyData
+{
+public:
+   EnergyCounter solar;   //!< Panel power (PPV)
+   EnergyCounter battery; //!< Battery power (P), in = charge, out = discharge
+   EnergyCounter grid;    //!< Grid power consumption
+
+public:
+   float getLoad(time_t time, bool daily);
+   void  Dump();
+};
+
 /**
   * Class for collecting all the global data.
   */
@@ -168,6 +183,10 @@ public:
    BMV          bmv;              //!< The BMW data
    MPPT         mppt;             //!< The MPPT data
    TasmotaElite tasmotaElite;     //!< The Tasmota Elite data
+   EnergyData   energy;           //!< The integrated energy
+
+   int          missingValues;    //!< Current values not updated by the last fetch
+   time_t       cachedTime;       //!< Time of the shown snapshot if nothing was fetched (0 = fetched)
 
 public:
    MyData()
@@ -176,9 +195,13 @@ public:
       , batteryCapacity(0)
       , sht30Temperatur(0)
       , sht30Humidity(0)
+      , missingValues(0)
+      , cachedTime(0)
    {
    }
 
+   bool IsStale();
+   void UpdateYields();
    void Dump();
    void LoadNVS();
    void SaveNVS();
@@ -198,6 +221,23 @@ void MyData::Dump()
    
    bmv.Dump();
    mppt.Dump();
+   energy.Dump();
+}
+
+/* Are some of the values not updated by the last fetch? */
+bool MyData::IsStale()
+{
+   return missingValues > 0 || cachedTime > 0 ||
+          bmv.chargeHistory.stale_ ||
+          mppt.ppvHistory.stale_ || mppt.yieldHistory.stale_ ||
+          tasmotaElite.powerHistory.stale_ || tasmotaElite.yieldHistory.stale_;
+}
+
+/* Fill the yield histories of the graphs with the integrated energy of every day. */
+void MyData::UpdateYields()
+{
+   energy.solar.renderDays(mppt.yieldHistory, mppt.ppvHistory);
+   energy.grid.renderDays(tasmotaElite.yieldHistory, tasmotaElite.powerHistory);
 }
 
 /* Load the NVS data from the non volatile memory */
@@ -261,3 +301,33 @@ void TasmotaElite::Dump()
    Serial.println("[elite] ampere: "  + String(ampere));
    Serial.println("[elite] power: "   + String(power));
 }
+
+/* House load of the hour (or the day) of the time: solar - battery charge + battery discharge + grid. */
+float EnergyData::getLoad(time_t time, bool daily)
+{
+   float load = 0.0;
+
+   if (daily) {
+      load = solar.getEnergy(solar.daysIn_, time) - battery.getEnergy(battery.daysIn_, time) +
+             battery.getEnergy(battery.daysOut_, time) + grid.getEnergy(grid.daysIn_, time);
+   } else {
+      load = solar.getEnergy(solar.hoursIn_, time) - battery.getEnergy(battery.hoursIn_, time) +
+             battery.getEnergy(battery.hoursOut_, time) + grid.getEnergy(grid.hoursIn_, time);
+   }
+   return load > 0.0 ? load : 0.0;
+}
+
+/* helper function to dump the energy of the last week */
+void EnergyData::Dump()
+{
+   for (int i = ENERGY_DAYS - 7; i < ENERGY_DAYS; i++) {
+      time_t day = solar.daysIn_.start_ + (time_t) i * 24 * 60 * 60;
+
+      Serial.println("[energy] " + getDateTimeString(day) +
+                     " solar: "       + String(solar.getEnergy(solar.daysIn_, day), 3) +
+                     " battery in: "  + String(battery.getEnergy(battery.daysIn_, day), 3) +
+                     " battery out: " + String(battery.getEnergy(battery.daysOut_, day), 3) +
+                     " grid: "        + String(grid.getEnergy(grid.daysIn_, day), 3) +
+                     " load: "        + String(getLoad(day, true), 3) + " kWh");
+   }
+}
@@ -134,7 +134,7 @@ void SolarDisplay::DrawGraph(int x, int y, int dx, int dy, HistoryData &powerHis
       
       canvas.setTextSize(1);
       for (int i = 0; i < powerHistory.size_; i++) {
-         DateTime date = powerHistory.dates_[i];
+         DateTime date = powerHistory.getDate(i);
          String   day  = String(date.day());
          
          if (oldDay != day && date.hour() >= 12) {
@@ -152,7 +152,7 @@ void SolarDisplay::DrawGraph(int x, int y, int dx, int dy, HistoryData &powerHis
       float yStep = (float) graphDY / (float) powerHistory.getMax();
       
       for (int i = 0; i < powerHistory.size_; i++) {
-         float yValue   = powerHistory.values_[i];
+         float yValue   = powerHistory.getValue(i);
          float yValueDY = (float) graphDY / (float) powerHistory.getMax();
          float xPos     = (float) graphX + graphDX / (float) powerHistory.size_ * i;
          float yPos     = (float) graphY + graphDY - (float) (yValue) * yValueDY;
@@ -161,7 +161,17 @@ void SolarDisplay::DrawGraph(int x, int y, int dx, int dy, HistoryData &powerHis
          if (yPos < graphY)           yPos = graphY;
    
          if (i > 0) {
-            canvas.drawLine(xPos, graphY + graphDY, xPos, yPos, M5EPD_Canvas::G15);         
+            if (powerHistory.isBand()) {
+               // Band history: light up to the highest, dark up to the lowest value of the bucket.
+               float yLow = (float) graphY + graphDY - powerHistory.getLow(i) * yValueDY;
+
+               if (yLow > graphY + graphDY) yLow = graphY + graphDY;
+               if (yLow < yPos)             yLow = yPos;
+               canvas.drawLine(xPos, yLow, xPos, yPos, M5EPD_Canvas::G6);
+               canvas.drawLine(xPos, graphY + graphDY, xPos, yLow, M5EPD_Canvas::G15);
+            } else {
+               canvas.drawLine(xPos, graphY + graphDY, xPos, yPos, M5EPD_Canvas::G15);
+            }
             // Serial.printf("GraphLine: %d %f %d, %d\n", i, yValue, (int) xPos, (int) yPos);
          }
       }
@@ -173,7 +183,7 @@ void SolarDisplay::DrawGraph(int x, int y, int dx, int dy, HistoryData &powerHis
       int   yLast = 0;
       
       for (int i = 0; i < chargeHistory->size_; i++) {
-         float yValue   = chargeHistory->values_[i];
+         float yValue   = chargeHistory->getValue(i);
          float yValueDY = (float) graphDY / (float) 1000.0;
          float xPos     = (float) graphX + graphDX / (float) chargeHistory->size_ * i;
          float yPos     = (float) graphY + graphDY - (float) (yValue) * yValueDY;
@@ -202,9 +212,9 @@ void SolarDisplay::DrawGraph(int x, int y, int dx, int dy, HistoryData &powerHis
       float  yMaxValue = 0.0;
 
       for (int i = 0; i < yieldHistory.size_; i++) {
-         DateTime date   = yieldHistory.dates_[i];
+         DateTime date   = yieldHistory.getDate(i);
          String   day    = String(date.day());
-         float    yValue = yieldHistory.values_[i];
+         float    yValue = yieldHistory.getValue(i);
          float    xPos   = graphX - 3 + i * xStep;
 
          if (yValue > yMaxValue) {
@@ -331,6 +341,12 @@ void SolarDisplay::DrawHeadVersion(int x, int y)
 void SolarDisplay::DrawHeadUpdated(int x, int y)
 {
    String updatedString = "Updated " + getDateTimeString(GetRTCTime());
+
+   if (myData.cachedTime > 0) {
+      updatedString = "Offline, data of " + getDateTimeString(myData.cachedTime);
+   } else if (myData.IsStale()) {
+      updatedString += " (partly cached)";
+   }
    
    canvas.drawCentreString(updatedString, x, y, 1);
 }
@@ -612,7 +628,7 @@ void SolarDisplay::DrawBody(int x, int y, int dx, int dy)
 /* Clear the update info part. */
 void SolarDisplay::ClearUpdateInfo()
 {
-   Serial.println("SolarDisplay::ClearUpdateInfo");
+   LOG_DEBUG("SolarDisplay::ClearUpdateInfo");
    
    canvas.createCanvas(400, 34);
    canvas.drawRect(0, 0, 400, 34, M5EPD_Canvas::G0);   
@@ -623,7 +639,7 @@ void SolarDisplay::ClearUpdateInfo()
 /* Fill the screen. */
 void SolarDisplay::Show()
 {
-   Serial.println("SolarDisplay::DrawSolarInfo");
+   LOG_DEBUG("SolarDisplay::DrawSolarInfo");
 
    canvas.setTextSize(2);
    canvas.setTextColor(WHITE, BLACK);
@@ -644,7 +660,7 @@ void SolarDisplay::Show()
 /* Show WiFi connewction error. */
 void SolarDisplay::ShowWiFiError(String ssid)
 {
-   Serial.println("SolarDisplay::ShowWiFiError");
+   LOG_DEBUG("SolarDisplay::ShowWiFiError");
 
    String errMsg = "WiFi error: [" + ssid + "]";
 
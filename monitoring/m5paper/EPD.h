@@ -43,7 +43,8 @@ void InitEPD(bool clearDisplay = true)
 */
 void ShutdownEPD(int sec)
 {
-   Serial.println("Shutdown (" + String((int) (sec / 60)) + " min)");
+   LOG_INFO("Shutdown (%d min)", (int) (sec / 60));
+   logger.flush(LOG_FLUSH_TIMEOUT);
 /*
    M5.disableEPDPower();
    M5.disableEXTPower();
@@ -32,23 +32,21 @@ bool StartWiFi(int &rssi)
    WiFi.setAutoConnect(true);
    WiFi.setAutoReconnect(true);
 
-   Serial.print("Connecting to ");
-   Serial.println(WIFI_SSID);
+   LOG_INFO("Connecting to %s", WIFI_SSID);
    
    WiFi.begin(WIFI_SSID, WIFI_PW);
 
    for (int retry = 0; WiFi.status() != WL_CONNECTED && retry < 30; retry++) {
       delay(500);
-      Serial.print(".");
    }
 
    rssi = 0;
    if (WiFi.status() == WL_CONNECTED) {
       rssi = WiFi.RSSI();
-      Serial.println("WiFi connected at: " + WiFi.localIP().toString());
+      LOG_INFO("WiFi connected at: %s", WiFi.localIP().toString().c_str());
       return true;
    } else {
-      Serial.println("WiFi connection *** FAILED ***");
+      LOG_ERROR("WiFi connection *** FAILED ***");
       return false;
    }
 }
@@ -56,7 +54,7 @@ bool StartWiFi(int &rssi)
 /* Stop the wifi connection */
 void StopWiFi() 
 {
-   Serial.println("Stop WiFi");
+   LOG_DEBUG("Stop WiFi");
    WiFi.disconnect();
    WiFi.mode(WIFI_OFF);
 }
@@ -0,0 +1,231 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Inflate.h
+  * 
+  * Stream inflater for gzip and deflate encoded http responses.
+  * Uses the miniz inflater of the ESP32 ROM, so it costs no flash.
+  */
+#pragma once
+#if __has_include(<esp32/rom/miniz.h>)
+  #include <esp32/rom/miniz.h>
+#else
+  #include <rom/miniz.h>
+#endif
+
+#define INFLATE_INPUT_SIZE 256                // Compressed bytes inflated at once
+#define INFLATE_DICT_SIZE  TINFL_LZ_DICT_SIZE // Deflate window (32k), also the output ring buffer
+
+/**
+  * Inflates a gzip (RFC 1952) or zlib (RFC 1950) stream byte by byte.
+  * The memory is only allocated between begin() and end().
+  */
+class Inflater
+{
+protected:
+   enum GZIP_STATE { GZIP_HEADER, GZIP_EXTRA_LEN, GZIP_EXTRA, GZIP_NAME, GZIP_COMMENT, GZIP_HCRC, GZIP_DATA };
+
+   tinfl_decompressor *decomp_;                   //!< Inflater state (ROM miniz)
+   uint8_t            *dict_;                     //!< Window and output ring buffer
+   size_t              dictOfs_;                  //!< Write position in the ring buffer
+   const uint8_t      *output_;                   //!< Start of the last output
+   int                 flags_;                    //!< tinfl flags
+   tinfl_status        status_;                   //!< Last tinfl status
+   bool                error_;                    //!< Broken stream or no memory
+
+   GZIP_STATE          gzipState_;                //!< Position in the gzip header
+   uint8_t             gzipFlags_;                //!< Flags of the gzip header
+   int                 gzipSkip_;                 //!< Bytes of the current header part
+   int                 gzipExtraLen_;             //!< Length of the FEXTRA part
+
+   uint8_t             in_[INFLATE_INPUT_SIZE];   //!< Buffered compressed bytes
+   size_t              inLen_;                    //!< Count of buffered bytes
+   size_t              inPos_;                    //!< Already inflated bytes of the buffer
+
+protected:
+   void pushGzipHeader(uint8_t c);
+   void nextGzipPart();
+
+public:
+   Inflater()
+      : decomp_(NULL)
+      , dict_(NULL)
+      , error_(false)
+   {
+   }
+   ~Inflater()
+   {
+      end();
+   }
+
+   bool           begin(bool gzip);
+   void           end();
+   bool           push(uint8_t c);
+   size_t         inflate();
+
+   bool           isStarted() { return decomp_ != NULL || error_; }
+   bool           isError()   { return error_;   }
+   const char    *getOutput() { return (const char *) output_; }
+};
+
+/* Start a new stream, gzip or zlib (http 'deflate'). */
+bool Inflater::begin(bool gzip)
+{
+   end();
+   decomp_ = (tinfl_decompressor *) malloc(sizeof(tinfl_decompressor));
+   dict_   = (uint8_t *) malloc(INFLATE_DICT_SIZE);
+   if (!decomp_ || !dict_) {
+      LOG_ERROR("Inflater: out of memory!");
+      end();
+      error_ = true;
+      return false;
+   }
+   tinfl_init(decomp_);
+   dictOfs_      = 0;
+   output_       = dict_;
+   flags_        = TINFL_FLAG_HAS_MORE_INPUT | (gzip ? 0 : TINFL_FLAG_PARSE_ZLIB_HEADER);
+   status_       = TINFL_STATUS_NEEDS_MORE_INPUT;
+   error_        = false;
+   gzipState_    = gzip ? GZIP_HEADER : GZIP_DATA;
+   gzipFlags_    = 0;
+   gzipSkip_     = 0;
+   gzipExtraLen_ = 0;
+   inLen_        = 0;
+   inPos_        = 0;
+   return true;
+}
+
+/* Free the memory of the stream. */
+void Inflater::end()
+{
+   free(decomp_);
+   free(dict_);
+   decomp_ = NULL;
+   dict_   = NULL;
+   error_  = false;
+}
+
+/* Continue with the next optional part of the gzip header. */
+void Inflater::nextGzipPart()
+{
+   gzipSkip_ = 0;
+   if (gzipFlags_ & 0x04) {        // FEXTRA
+      gzipFlags_ &= ~0x04;
+      gzipState_  = GZIP_EXTRA_LEN;
+   } else if (gzipFlags_ & 0x08) { // FNAME
+      gzipFlags_ &= ~0x08;
+      gzipState_  = GZIP_NAME;
+   } else if (gzipFlags_ & 0x10) { // FCOMMENT
+      gzipFlags_ &= ~0x10;
+      gzipState_  = GZIP_COMMENT;
+   } else if (gzipFlags_ & 0x02) { // FHCRC
+      gzipFlags_ &= ~0x02;
+      gzipState_  = GZIP_HCRC;
+   } else {
+      gzipState_  = GZIP_DATA;
+   }
+}
+
+/* One byte of the gzip header. */
+void Inflater::pushGzipHeader(uint8_t c)
+{
+   switch (gzipState_) {
+      case GZIP_HEADER: // ID1 ID2 CM FLG MTIME(4) XFL OS
+         if ((gzipSkip_ == 0 && c != 0x1f) || (gzipSkip_ == 1 && c != 0x8b) || (gzipSkip_ == 2 && c != 8)) {
+            LOG_ERROR("Inflater: no gzip stream!");
+            error_ = true;
+         } else if (gzipSkip_ == 3) {
+            gzipFlags_ = c;
+         }
+         if (++gzipSkip_ == 10) {
+            nextGzipPart();
+         }
+         break;
+      case GZIP_EXTRA_LEN:
+         gzipExtraLen_ |= c << (8 * gzipSkip_); // little endian
+         if (++gzipSkip_ == 2) {
+            gzipSkip_  = 0;
+            gzipState_ = GZIP_EXTRA;
+            if (gzipExtraLen_ == 0) {
+               nextGzipPart();
+            }
+         }
+         break;
+      case GZIP_EXTRA:
+         if (++gzipSkip_ >= gzipExtraLen_) {
+            nextGzipPart();
+         }
+         break;
+      case GZIP_NAME:
+      case GZIP_COMMENT:
+         if (c == 0) {
+            nextGzipPart();
+         }
+         break;
+      case GZIP_HCRC:
+         if (++gzipSkip_ == 2) {
+            nextGzipPart();
+         }
+         break;
+      case GZIP_DATA:
+         break;
+   }
+}
+
+/* Push one compressed byte, returns true if the input buffer is full and must be inflated. */
+bool Inflater::push(uint8_t c)
+{
+   if (!decomp_ || error_) {
+      return false;
+   }
+   if (gzipState_ != GZIP_DATA) {
+      pushGzipHeader(c);
+      return false;
+   }
+   if (status_ == TINFL_STATUS_DONE) {
+      return false; // gzip trailer (crc32, size)
+   }
+   in_[inLen_++] = c;
+   return inLen_ == INFLATE_INPUT_SIZE;
+}
+
+/* 
+ * Inflate the buffered input. Returns the count of the new bytes at getOutput().
+ * Call it until it returns 0.
+ */
+size_t Inflater::inflate()
+{
+   size_t inSize  = inLen_ - inPos_;
+   size_t outSize = INFLATE_DICT_SIZE - dictOfs_;
+
+   if (!decomp_ || error_ || status_ == TINFL_STATUS_DONE) {
+      return 0;
+   }
+   status_  = tinfl_decompress(decomp_, in_ + inPos_, &inSize, dict_, dict_ + dictOfs_, &outSize, flags_);
+   inPos_  += inSize;
+   output_  = dict_ + dictOfs_;
+   dictOfs_ = (dictOfs_ + outSize) & (INFLATE_DICT_SIZE - 1);
+   if (inPos_ >= inLen_) {
+      inLen_ = 0;
+      inPos_ = 0;
+   }
+   if (status_ < TINFL_STATUS_DONE) {
+      LOG_ERROR("Inflater: broken stream (%d)!", (int) status_);
+      error_ = true;
+   }
+   return outSize;
+}
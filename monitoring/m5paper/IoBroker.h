@@ -20,19 +20,67 @@
   * Helper function to communicate with the IoBroker.
   */
 #pragma once
+#include <stddef.h>
+#include <limits.h>
+#include <math.h>
+#include <lwip/sockets.h>
+#include <esp_heap_caps.h>
+#include "Inflate.h"
+#if DATA_SOURCE == DATA_SOURCE_MQTT
+  #include <PubSubClient.h>
+#endif
 
 #define IOBROKER_QUERY     "/query/"
 #define IOBROKER_GET       "/get/"
 #define IOBROKER_GET_PLAIN "/getPlainValue/"
+#define IOBROKER_GET_BULK  "/getBulk/"
+
+#define BULK_MAX_ITEMS     32   // Max states of one bulk request
+#define BULK_KEY_SIZE      8    // Max length of a json key (id, val, ts)
+#define BULK_ID_SIZE       64   // Max length of a state id
+#define BULK_VALUE_SIZE    32   // Max length of a json value
+#define BULK_TOKEN_SIZE    BULK_ID_SIZE // Max length of any json token, the ids are the longest
+
+#define HISTORY_RAW_COUNT        200000         // Max raw points of a not aggregated history request
+#define HISTORY_RECIPROCAL_SHIFT 52             // Fixed point shift of the reciprocal bucket width
+#define HISTORY_TIER_COUNT       3              // Resolutions of the history archive
+#define HISTORY_ENERGY_RANGE     (12 * 60 * 60) // Max range of the raw points for the energy integration (sec)
+
+#define MQTT_BUFFER_SIZE     512  // Max length of a mqtt message (Tasmota SENSOR)
+#define MQTT_COLLECT_TIMEOUT 2000 // Max time to collect the retained messages (msec)
+#define MQTT_QUIET_TIME      500  // No more retained messages after this time (msec)
+
+#define MQTT_IOBROKER_PREFIX    "mqtt.0."                // IoBroker id prefix of the mqtt topics
+#define TASMOTA_IOBROKER_PREFIX "sonoff.0.TasmotaElite." // IoBroker id prefix of the Tasmota values
+
+#define PIPELINE_MAX_REQUESTS 16              // Max queued requests of one pipeline
+#define HTTP_LINE_SIZE        64              // Max length of a parsed status or header line
+#define HTTP_ACCEPT_ENCODING  "gzip, deflate" // Compressed responses we can inflate
+#define POOL_CONNECTIONS      3               // Parallel connections of the IoBrokerPool
+#define FETCH_MAX_HISTORIES   8               // Max history bindings of the IoBrokerFetcher
+#define FETCH_TIME_BUDGET     20000           // Max time of all IoBroker requests of one wake (msec)
+
+#define BIND_FIELD(member) offsetof(MyData, member) // Offset of a bound MyData field
+#define BIND_NONE          ((size_t) -1)            // No bound field
+#define BINDING_COUNT(b)   (sizeof(b) / sizeof(b[0]))
 
 #define CONNECT_TIMEOUT    4000 // msec
 #define REQUEST_TIMEOUT    4000 // msec
 
 class IoBrokerWifiClient; //!< Wifi connection class
+class HttpResponseParser; //!< Parser of the http response
 class IoBrokerBase;       //!< Base class for IoBroker communication
+class IoBrokerPool;       //!< Parallel connections
 class IoBrokerPlain;      //!< Plain value (double/string) request
 class IoBrokerValue;      //!< get values request
+class IoBrokerBulk;       //!< get many values with one request
+class HistoryTokenizer;   //!< Parser of the history result
+class HistoryAggregator;  //!< Binning of the history points
 class IoBrokerHistory;    //!< History request
+class HistoryArchive;     //!< Multi resolution store of one history
+class IoBrokerEnergy;     //!< Power request for the energy integration only
+class MqttValues;         //!< Current values from the retained mqtt messages
+class IoBrokerFetcher;    //!< Reads all the bound MyData fields
 
 
 /* ***************************************************************************** */
@@ -44,22 +92,74 @@ class IoBrokerHistory;    //!< History request
   */
 class IoBrokerWifiClient
 {
+   friend class IoBrokerPool;
+
 public:
    WiFiClient client_; //!< wifi client
 
+protected:
+   enum PIPELINE_STATE { PIPELINE_UNKNOWN, PIPELINE_SUPPORTED, PIPELINE_UNSUPPORTED };
+
+   /** One queued request */
+   struct PipelineItem
+   {
+      IoBrokerBase *handler; //!< Receiver of the response
+      String        url;     //!< Request url
+   };
+
+   unsigned long         waitMillis_;                      //!< Time waiting for the network (msec)
+   uint32_t              requests_;                        //!< Count of the sent requests
+   uint32_t              sentBytes_;                       //!< Bytes of the sent requests
+   uint32_t              receivedBytes_;                   //!< Bytes of the received responses
+   PipelineItem          pipeline_[PIPELINE_MAX_REQUESTS]; //!< Queued requests
+   int                   pipelineCount_;                   //!< Count of the queued requests
+   int                   pipelineRead_;                    //!< Index of the current response
+   int                   pipelineWritten_;                 //!< Count of the written requests
+   static PIPELINE_STATE pipelineState_;                   //!< Does the server answer pipelined requests
+   static unsigned long  budgetStart_;                     //!< Start of the time budget
+   static unsigned long  budgetMillis_;                    //!< Time budget of the current fetch (0 = unlimited)
+
 public:
    bool connect();
    void disconnect();
    bool connected(bool reconnect = true);
-   void waitForAvailable();
+   bool waitReadable(unsigned long timeout);
+
+   unsigned long getWaitTimeout();
+
+   unsigned long getWaitMillis() { return waitMillis_; }
+   void          addReceived(uint32_t bytes) { receivedBytes_ += bytes; }
+   void          dumpStatistic(unsigned long totalMillis, uint32_t freeHeap);
+
+   void writeRequest(IoBrokerBase *handler, String url);
+   bool queueRequest(IoBrokerBase *handler, String url);
+   bool pollPipeline();
+   void sendPipeline();
+
+   unsigned long getPipelineTimeout();
+
+   static void          startBudget    (unsigned long budget);
+   static unsigned long getBudgetMillis();
+   static bool          isBudgetExpired();
    
 public:
    IoBrokerWifiClient();
    ~IoBrokerWifiClient();
 };
 
+IoBrokerWifiClient::PIPELINE_STATE IoBrokerWifiClient::pipelineState_ = IoBrokerWifiClient::PIPELINE_UNKNOWN;
+unsigned long                      IoBrokerWifiClient::budgetStart_   = 0;
+unsigned long                      IoBrokerWifiClient::budgetMillis_  = 0;
+
 /* Constructor: Connect to the IoBroker server. */
 IoBrokerWifiClient::IoBrokerWifiClient()
+   : waitMillis_(0)
+   , requests_(0)
+   , sentBytes_(0)
+   , receivedBytes_(0)
+   , pipelineCount_(0)
+   , pipelineRead_(0)
+   , pipelineWritten_(0)
 {
    connect();
 }
@@ -75,14 +175,16 @@ IoBrokerWifiClient::~IoBrokerWifiClient()
 /* Connect to the specific IoBroker server. */
 bool IoBrokerWifiClient::connect()
 {
-   Serial.print("try to connect to IoBroker!");
+   if (isBudgetExpired()) {
+      LOG_INFO("IoBroker: connect -> no time left!");
+      return false;
+   }
    if (!client_.connect(IOBROKER_URL, IOBROKER_PORT)) {
-      Serial.println(" -> connection failed!");
+      LOG_ERROR("IoBroker: connect -> connection failed!");
       return false;
-   } else {
-      Serial.println(" -> connected!");
-      return true;
    }
+   LOG_DEBUG("IoBroker: connect -> connected!");
+   return true;
 }
 
 /* Disconnect the IoBroker server. */
@@ -104,18 +206,272 @@ bool IoBrokerWifiClient::connected(bool reconnect /*= true*/)
    return client_.connected();
 }
 
-/* Wait until the server is available. */
-void IoBrokerWifiClient::waitForAvailable()
+/* Max time to wait for the first byte of a response. */
+unsigned long IoBrokerWifiClient::getWaitTimeout()
 {
-   unsigned long _startMillis = millis();
+   return CONNECT_TIMEOUT;
+}
 
-   while (!client_.available()) {
-      if (millis() - _startMillis > CONNECT_TIMEOUT) {
-         Serial.println("wait timeout!");          
-         client_.stop(); 
-         break;
+/* 
+ * Sleep in select() until the socket is readable (data or close) or the timeout ends.
+ * The cpu is free for the idle task meanwhile. Returns false on timeout.
+ */
+bool IoBrokerWifiClient::waitReadable(unsigned long timeout)
+{
+   int            fd    = client_.fd();
+   unsigned long  start = millis();
+   fd_set         readSet;
+   struct timeval tv;
+   int            ret;
+
+   if (fd < 0) {
+      return false;
+   }
+   FD_ZERO(&readSet);
+   FD_SET(fd, &readSet);
+   tv.tv_sec  = timeout / 1000;
+   tv.tv_usec = (timeout % 1000) * 1000;
+   ret        = select(fd + 1, &readSet, NULL, NULL, &tv);
+   waitMillis_ += millis() - start;
+   return ret > 0;
+}
+
+/* Start the time budget of all the following requests (msec, 0 = unlimited). */
+void IoBrokerWifiClient::startBudget(unsigned long budget)
+{
+   budgetStart_  = millis();
+   budgetMillis_ = budget;
+}
+
+/* Remaining time of the budget. */
+unsigned long IoBrokerWifiClient::getBudgetMillis()
+{
+   unsigned long elapsed = millis() - budgetStart_;
+
+   if (budgetMillis_ == 0) {
+      return ULONG_MAX;
+   }
+   return elapsed < budgetMillis_ ? budgetMillis_ - elapsed : 0;
+}
+
+/* Is the time budget used up? */
+bool IoBrokerWifiClient::isBudgetExpired()
+{
+   return getBudgetMillis() == 0;
+}
+
+/* Print the network statistic and the heap use of one complete fetch. */
+void IoBrokerWifiClient::dumpStatistic(unsigned long totalMillis, uint32_t freeHeap)
+{
+   LOG_INFO("IoBroker statistic: %lu ms total, %lu ms idle, %u requests, %u bytes sent, %u bytes received",
+            totalMillis, waitMillis_, requests_, sentBytes_, receivedBytes_);
+   LOG_INFO("IoBroker heap: %u bytes free before, %zu after, %zu min since boot, %zu largest block",
+            freeHeap, heap_caps_get_free_size(MALLOC_CAP_8BIT), heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+            heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+}
+
+/* ***************************************************************************** */
+/* *** class HttpResponseParser ************************************************ */
+/* ***************************************************************************** */
+
+/**
+  * Push based parser of one HTTP/1.1 response.
+  * Reads the status line and the headers and finds the exact end of the body
+  * with the Content-Length, the chunked transfer encoding or the connection close.
+  */
+class HttpResponseParser
+{
+protected:
+   enum HTTP_STATE { HTTP_STATUS, HTTP_HEADER, HTTP_BODY, HTTP_BODY_UNTIL_CLOSE,
+                     HTTP_CHUNK_SIZE, HTTP_CHUNK_EXT, HTTP_CHUNK_DATA, HTTP_CHUNK_END,
+                     HTTP_TRAILER, HTTP_DONE };
+
+   enum HTTP_ENCODING { HTTP_IDENTITY, HTTP_GZIP, HTTP_DEFLATE };
+
+   HTTP_STATE    state_;                //!< Current part of the response
+   HTTP_ENCODING encoding_;             //!< Content-Encoding of the body
+   char          line_[HTTP_LINE_SIZE]; //!< Current status or header line
+   int           lineLen_;              //!< Length of the current line
+   int           status_;               //!< Status code
+   bool          keepAlive_;            //!< The server keeps the connection open
+   bool          chunked_;              //!< Transfer-Encoding: chunked
+   long          contentLength_;        //!< Content-Length (-1 = unknown)
+   long          remaining_;            //!< Remaining bytes of the body or the chunk
+
+protected:
+   void onLine();
+   void onHeader(const char *name, const char *value);
+   void onHeadEnd();
+
+public:
+   HttpResponseParser()
+   {
+      reset();
+   }
+
+   void reset();
+   bool push(char c);
+   void onClose();
+
+   bool isDone()       { return state_ == HTTP_DONE;             }
+   bool isSuccess()    { return status_ >= 200 && status_ < 300; }
+   bool isKeepAlive()  { return keepAlive_;                      }
+   int  getStatus()    { return status_;                         }
+   bool isCompressed() { return encoding_ != HTTP_IDENTITY;      }
+   bool isGzip()       { return encoding_ == HTTP_GZIP;          }
+};
+
+/* Start a new response. */
+void HttpResponseParser::reset()
+{
+   state_         = HTTP_STATUS;
+   lineLen_       = 0;
+   status_        = 0;
+   keepAlive_     = true;
+   chunked_       = false;
+   encoding_      = HTTP_IDENTITY;
+   contentLength_ = -1;
+   remaining_     = 0;
+}
+
+/* One header 'name: value', the name is lower case. */
+void HttpResponseParser::onHeader(const char *name, const char *value)
+{
+   if (strcmp(name, "content-length") == 0) {
+      contentLength_ = atol(value);
+   } else if (strcmp(name, "content-encoding") == 0) {
+      if (strcasestr(value, "gzip")) {
+         encoding_ = HTTP_GZIP;
+      } else if (strcasestr(value, "deflate")) {
+         encoding_ = HTTP_DEFLATE;
+      }
+   } else if (strcmp(name, "transfer-encoding") == 0) {
+      chunked_ = strcasestr(value, "chunked") != NULL;
+   } else if (strcmp(name, "connection") == 0) {
+      if (strcasestr(value, "close")) {
+         keepAlive_ = false;
+      } else if (strcasestr(value, "keep-alive")) {
+         keepAlive_ = true;
+      }
+   }
+}
+
+/* The head is complete, how is the end of the body found? */
+void HttpResponseParser::onHeadEnd()
+{
+   if (status_ >= 100 && status_ < 200) {
+      reset(); // '100 Continue', the real response follows
+   } else if (status_ == 204 || status_ == 304 || contentLength_ == 0) {
+      state_ = HTTP_DONE;
+   } else if (chunked_) {
+      state_     = HTTP_CHUNK_SIZE;
+      remaining_ = 0;
+   } else if (contentLength_ > 0) {
+      state_     = HTTP_BODY;
+      remaining_ = contentLength_;
+   } else {
+      state_     = HTTP_BODY_UNTIL_CLOSE;
+      keepAlive_ = false;
+   }
+}
+
+/* A status, header or trailer line is complete. */
+void HttpResponseParser::onLine()
+{
+   line_[lineLen_] = '\0';
+   if (state_ == HTTP_STATUS) {
+      // 'HTTP/1.1 200 OK'
+      if (strncmp(line_, "HTTP/", 5) == 0) {
+         char *space = strchr(line_, ' ');
+
+         status_    = space ? atoi(space + 1) : 0;
+         keepAlive_ = strncmp(line_, "HTTP/1.0", 8) != 0;
+         state_     = HTTP_HEADER;
+      }
+   } else if (state_ == HTTP_HEADER) {
+      if (lineLen_ == 0) {
+         onHeadEnd();
+      } else {
+         char *colon = strchr(line_, ':');
+
+         if (colon) {
+            *colon = '\0';
+            for (char *p = line_; *p; p++) {
+               *p = tolower(*p);
+            }
+            colon++;
+            while (*colon == ' ') {
+               colon++;
+            }
+            onHeader(line_, colon);
+         }
       }
+   } else if (state_ == HTTP_TRAILER) {
+      if (lineLen_ == 0) {
+         state_ = HTTP_DONE;
+      }
+   }
+   lineLen_ = 0;
+}
+
+/* Push one received char, returns true if it is part of the body. */
+bool HttpResponseParser::push(char c)
+{
+   switch (state_) {
+      case HTTP_STATUS:
+      case HTTP_HEADER:
+      case HTTP_TRAILER:
+         if (c == '\n') {
+            onLine();
+         } else if (c != '\r' && lineLen_ < HTTP_LINE_SIZE - 1) {
+            line_[lineLen_++] = c; // longer lines are cut, we need only the start
+         }
+         break;
+      case HTTP_BODY:
+         if (--remaining_ <= 0) {
+            state_ = HTTP_DONE;
+         }
+         return true;
+      case HTTP_BODY_UNTIL_CLOSE:
+         return true;
+      case HTTP_CHUNK_SIZE:
+         if (isxdigit(c)) {
+            remaining_ = remaining_ * 16 + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+         } else if (c == ';') {
+            state_ = HTTP_CHUNK_EXT;
+         } else if (c == '\n') {
+            state_ = remaining_ > 0 ? HTTP_CHUNK_DATA : HTTP_TRAILER;
+         }
+         break;
+      case HTTP_CHUNK_EXT:
+         if (c == '\n') {
+            state_ = remaining_ > 0 ? HTTP_CHUNK_DATA : HTTP_TRAILER;
+         }
+         break;
+      case HTTP_CHUNK_DATA:
+         if (--remaining_ <= 0) {
+            state_ = HTTP_CHUNK_END;
+         }
+         return true;
+      case HTTP_CHUNK_END:
+         if (c == '\n') {
+            state_     = HTTP_CHUNK_SIZE; // '\r\n' behind the chunk data
+            remaining_ = 0;
+         }
+         break;
+      case HTTP_DONE:
+         break;
    }
+   return false;
+}
+
+/* The server has closed the connection, this ends a body without length. */
+void HttpResponseParser::onClose()
+{
+   if (state_ == HTTP_BODY_UNTIL_CLOSE) {
+      state_ = HTTP_DONE;
+   }
+   keepAlive_ = false;
 }
 
 /* ***************************************************************************** */
@@ -127,11 +483,25 @@ void IoBrokerWifiClient::waitForAvailable()
   */
 class IoBrokerBase
 {
+   friend class IoBrokerWifiClient;
+
 protected:
    IoBrokerWifiClient &wifiClient_; //!< Reference to the IoBroker wifiClient
+   bool                received_;   //!< The last response is complete and has data
+   bool                reusable_;   //!< The last response is complete and the connection stays open
+   HttpResponseParser  http_;       //!< Parser of the http response
+   Inflater            inflater_;   //!< Inflater of a compressed body
+   unsigned long       ticks_;      //!< Start of the response or time of the last received data
+   uint32_t            length_;     //!< Received bytes of the current response
 
 protected:
-   void parseContentLen(int &len, String line);
+   void          beginResponse     ();
+   bool          pollResponse      (IoBrokerWifiClient &client);
+   bool          endResponse       (IoBrokerWifiClient &client);
+   bool          readResponse      (IoBrokerWifiClient &client);
+   unsigned long getRemainingMillis(IoBrokerWifiClient &client);
+   void          onBody            (char c);
+   void          inflateBody       ();
 
    virtual void onRequest ()       = 0;
    virtual void onChar    (char c) = 0;
@@ -139,70 +509,343 @@ protected:
 public:
    IoBrokerBase(IoBrokerWifiClient &ioBrokerWifiClient)
       : wifiClient_(ioBrokerWifiClient)
+      , received_(false)
+      , reusable_(false)
+      , ticks_(0)
+      , length_(0)
    {
    }
+   virtual ~IoBrokerBase() {}
 
    bool sendRequest(String method, String topic, String param = "");
 };
 
-/* Read the Content-Length header. */
-void IoBrokerBase::parseContentLen(int &len, String line)
+/* Start to read a new response. */
+void IoBrokerBase::beginResponse()
 {
-   static String lenString = "Content-Length:";
-   
-   int index = line.indexOf(lenString);
-   
-   if (index != -1) {
-      len = atoi(line.substring(index + lenString.length()).c_str());
+   received_ = false;
+   reusable_ = false;
+   length_   = 0;
+   ticks_    = millis();
+   http_.reset();
+}
+
+/* Time until the current response runs into its timeout, the first byte may take longer. */
+unsigned long IoBrokerBase::getRemainingMillis(IoBrokerWifiClient &client)
+{
+   unsigned long timeout = length_ > 0 ? REQUEST_TIMEOUT : client.getWaitTimeout();
+   unsigned long elapsed = millis() - ticks_;
+
+   return min(elapsed < timeout ? timeout - elapsed : 0, IoBrokerWifiClient::getBudgetMillis());
+}
+
+/* 
+ * Read the available data of the response and pass the body to onChar().
+ * Returns true if the response is finished: complete, closed or timed out.
+ * The response ends exactly with its body, no flush(), it would drop the next pipelined response.
+ */
+bool IoBrokerBase::pollResponse(IoBrokerWifiClient &client)
+{
+   while (!http_.isDone() && client.client_.available()) {
+      char c = (char) client.client_.read();
+
+      client.addReceived(1);
+      length_++;
+      if (http_.push(c) && http_.isSuccess()) {
+         onBody(c);
+      }
+      ticks_ = millis();
+   }
+   if (http_.isDone()) {
+      return true;
+   }
+   if (!client.client_.connected()) {
+      http_.onClose();
+      return true;
+   }
+   inflateBody(); // use the time until the next data arrive
+   if (getRemainingMillis(client) == 0) {
+      LOG_ERROR(length_ > 0 ? "IoBroker: response -> timeout!" : "IoBroker: response -> wait timeout!");
+      return true;
+   }
+   return false;
+}
+
+/* Finish the response. A cut response failed, a connection in an unknown state is closed. */
+bool IoBrokerBase::endResponse(IoBrokerWifiClient &client)
+{
+   inflateBody();
+   if (inflater_.isError() || !http_.isDone()) {
+      received_ = false;
+   }
+   inflater_.end();
+   reusable_ = http_.isDone() && http_.isKeepAlive();
+   if (!reusable_) {
+      client.disconnect();
+   }
+   if (http_.isSuccess()) {
+      LOG_DEBUG("IoBroker: response -> ok");
+   } else {
+      LOG_ERROR("IoBroker: response -> http status %d", http_.getStatus());
+   }
+   return received_;
+}
+
+/* Read one complete http response. */
+bool IoBrokerBase::readResponse(IoBrokerWifiClient &client)
+{
+   beginResponse();
+   while (!pollResponse(client)) {
+      client.waitReadable(getRemainingMillis(client));
+   }
+   return endResponse(client);
+}
+
+/* One char of the body, a compressed body is collected for the inflater. */
+void IoBrokerBase::onBody(char c)
+{
+   if (!http_.isCompressed()) {
+      onChar(c);
+      received_ = true;
+   } else {
+      if (!inflater_.isStarted()) {
+         inflater_.begin(http_.isGzip());
+      }
+      if (inflater_.push(c)) {
+         inflateBody();
+      }
+   }
+}
+
+/* Inflate the collected compressed chars and pass them to onChar(). */
+void IoBrokerBase::inflateBody()
+{
+   size_t len;
+
+   while ((len = inflater_.inflate()) > 0) {
+      const char *output = inflater_.getOutput();
+
+      for (size_t i = 0; i < len; i++) {
+         onChar(output[i]);
+      }
+      received_ = true;
    }
 }
 
 /* Read a String from IoBroker. */
 bool IoBrokerBase::sendRequest(String method, String topic, String param) 
 {
-   bool ret = false;
-
-   Serial.print("sendRequest! ");
+   if (IoBrokerWifiClient::isBudgetExpired()) {
+      LOG_INFO("IoBroker: %s skipped, no time left!", topic.c_str());
+      return false;
+   }
    if (wifiClient_.connected()) {
-      int    ticks         = 0;
-      int    readLength    = 0;
-      int    contentLength = -1;
-      String url           = method + topic + param;
+      wifiClient_.writeRequest(this, method + topic + param);
+      return readResponse(wifiClient_);
+   }
+   return false;
+}
 
-      // This will send the request to the server
-      onRequest();
-      Serial.print(url);
-      wifiClient_.client_.print("GET " + url + " HTTP/1.1\r\nConnection: keep-alive\r\n\r\n");      
-      wifiClient_.client_.flush();
-
-      wifiClient_.waitForAvailable();
-      // Read http response head
-      while (wifiClient_.client_.available()) {
-         String line = wifiClient_.client_.readStringUntil('\n');
-         
-         parseContentLen(contentLength, line);
-         if (line == "\r") break;
-      }    
-
-      // Read http response body
-      ticks = millis();
-      do {
-         if (wifiClient_.client_.available()) {
-            onChar((char) wifiClient_.client_.read());
-            ticks = millis();
-            readLength++;
-            ret = true;
-         } else {
-            if (millis() - ticks > REQUEST_TIMEOUT) {
-               Serial.println("IoBrokerBase::sendRequest() -> send timeout!");
-               break;
+/* Send one request, the handler is reset for the response. */
+void IoBrokerWifiClient::writeRequest(IoBrokerBase *handler, String url)
+{
+   handler->onRequest();
+   LOG_DEBUG("IoBroker: %s", url.c_str());
+   requests_++;
+   sentBytes_ += client_.print("GET " + url + " HTTP/1.1\r\nConnection: keep-alive\r\nAccept-Encoding: " HTTP_ACCEPT_ENCODING "\r\n\r\n");
+}
+
+/* Add a request to the pipeline, the response is passed to the handler. */
+bool IoBrokerWifiClient::queueRequest(IoBrokerBase *handler, String url)
+{
+   handler->received_ = false;
+   if (pipelineCount_ >= PIPELINE_MAX_REQUESTS) {
+      LOG_ERROR("IoBrokerWifiClient: pipeline full, %s ignored!", url.c_str());
+      return false;
+   }
+   pipeline_[pipelineCount_].handler = handler;
+   pipeline_[pipelineCount_].url     = url;
+   pipelineCount_++;
+   return true;
+}
+
+/* 
+ * Continue the pipeline: write the requests, read the available response data
+ * and pass them in order to their handlers. Returns true if the pipeline is complete.
+ * The first response shows if the server keeps the connection open and the
+ * end of the body was found. Only then the other requests are written back-to-back.
+ * If the server closes a pipelined connection the remaining requests are sent
+ * again one by one.
+ */
+bool IoBrokerWifiClient::pollPipeline()
+{
+   while (pipelineRead_ < pipelineCount_) {
+      IoBrokerBase *handler = pipeline_[pipelineRead_].handler;
+
+      if (pipelineWritten_ <= pipelineRead_) {
+         if (!connected()) {
+            LOG_INFO("IoBrokerWifiClient: %d requests skipped!", pipelineCount_ - pipelineRead_);
+            pipelineRead_ = pipelineCount_; // no server or no time left, the remaining requests fail
+            break;
+         }
+         writeRequest(handler, pipeline_[pipelineRead_].url);
+         handler->beginResponse();
+         pipelineWritten_ = pipelineRead_ + 1;
+         if (pipelineState_ == PIPELINE_SUPPORTED) {
+            for (; pipelineWritten_ < pipelineCount_; pipelineWritten_++) {
+               writeRequest(pipeline_[pipelineWritten_].handler, pipeline_[pipelineWritten_].url);
             }
          }
-      } while (contentLength == -1 || readLength < contentLength);
-      wifiClient_.client_.flush();
-      Serial.println(" -> ok");
+      }
+      if (!handler->pollResponse(*this)) {
+         return false; // wait for more data
+      }
+      handler->endResponse(*this);
+      if (handler->reusable_) {
+         if (pipelineState_ == PIPELINE_UNKNOWN) {
+            pipelineState_ = PIPELINE_SUPPORTED;
+         }
+      } else {
+         // A response cut by the time budget says nothing about the server.
+         if (pipelineState_ != PIPELINE_UNSUPPORTED && !isBudgetExpired()) {
+            LOG_INFO("IoBrokerWifiClient: no pipelining, send single requests!");
+            pipelineState_ = PIPELINE_UNSUPPORTED;
+         }
+         pipelineWritten_ = pipelineRead_ + 1; // the connection is closed, the pending requests are sent again
+      }
+      pipelineRead_++;
+      if (pipelineRead_ < pipelineWritten_) {
+         pipeline_[pipelineRead_].handler->beginResponse();
+      }
+   }
+   pipelineCount_   = 0;
+   pipelineRead_    = 0;
+   pipelineWritten_ = 0;
+   return true;
+}
+
+/* Time until the current response of the pipeline runs into its timeout. */
+unsigned long IoBrokerWifiClient::getPipelineTimeout()
+{
+   if (pipelineRead_ < pipelineCount_) {
+      return pipeline_[pipelineRead_].handler->getRemainingMillis(*this);
+   }
+   return 0;
+}
+
+/* Send all queued requests and pass the responses in order to their handlers. */
+void IoBrokerWifiClient::sendPipeline()
+{
+   LOG_DEBUG("IoBrokerWifiClient: send %d pipelined requests", pipelineCount_);
+   while (!pollPipeline()) {
+      waitReadable(getPipelineTimeout());
+   }
+}
+
+/* ***************************************************************************** */
+/* *** class IoBrokerPool ****************************************************** */
+/* ***************************************************************************** */
+
+/**
+  * Pool of IoBroker connections.
+  * The requests queued on the main connection are spread over all connections
+  * and read at the same time, so the slow database queries of the server overlap.
+  * Every connection pipelines its own share of the requests.
+  */
+class IoBrokerPool
+{
+protected:
+   IoBrokerWifiClient &main_;                               //!< The main connection with the queued requests
+   IoBrokerWifiClient  extraClients_[POOL_CONNECTIONS - 1]; //!< The additional connections
+   IoBrokerWifiClient *clients_[POOL_CONNECTIONS];          //!< All connections, the main one first
+
+protected:
+   void waitReadable(unsigned long timeout);
+
+public:
+   IoBrokerPool(IoBrokerWifiClient &wifiClient);
+   ~IoBrokerPool();
+
+   void run();
+};
+
+/* Constructor: Connect the additional connections. */
+IoBrokerPool::IoBrokerPool(IoBrokerWifiClient &wifiClient)
+   : main_(wifiClient)
+{
+   clients_[0] = &main_;
+   for (int i = 1; i < POOL_CONNECTIONS; i++) {
+      clients_[i] = &extraClients_[i - 1];
+   }
+}
+
+/* Destructor: Add the statistic of the additional connections to the main one. */
+IoBrokerPool::~IoBrokerPool()
+{
+   for (int i = 0; i < POOL_CONNECTIONS - 1; i++) {
+      main_.requests_      += extraClients_[i].requests_;
+      main_.sentBytes_     += extraClients_[i].sentBytes_;
+      main_.receivedBytes_ += extraClients_[i].receivedBytes_;
+   }
+}
+
+/* Sleep in select() until one of the busy connections is readable or the timeout ends. */
+void IoBrokerPool::waitReadable(unsigned long timeout)
+{
+   unsigned long  start = millis();
+   fd_set         readSet;
+   struct timeval tv;
+   int            maxFd = -1;
+
+   FD_ZERO(&readSet);
+   for (int i = 0; i < POOL_CONNECTIONS; i++) {
+      int fd = clients_[i]->client_.fd();
+
+      if (clients_[i]->pipelineCount_ > 0 && fd >= 0) {
+         FD_SET(fd, &readSet);
+         if (fd > maxFd) {
+            maxFd = fd;
+         }
+      }
+   }
+   if (maxFd >= 0) {
+      tv.tv_sec  = timeout / 1000;
+      tv.tv_usec = (timeout % 1000) * 1000;
+      select(maxFd + 1, &readSet, NULL, NULL, &tv);
+   }
+   main_.waitMillis_ += millis() - start;
+}
+
+/* Spread the queued requests round robin over the connections and run all pipelines together. */
+void IoBrokerPool::run()
+{
+   int count = main_.pipelineCount_;
+
+   // The main queue is refilled in place, its entry i / POOL_CONNECTIONS is always already taken.
+   main_.pipelineCount_ = 0;
+   for (int i = 0; i < count; i++) {
+      IoBrokerBase *handler = main_.pipeline_[i].handler;
+      String        url     = main_.pipeline_[i].url;
+
+      clients_[i % POOL_CONNECTIONS]->queueRequest(handler, url);
+   }
+
+   LOG_DEBUG("IoBrokerPool: %d requests on %d connections", count, POOL_CONNECTIONS);
+   for (;;) {
+      bool          done    = true;
+      unsigned long timeout = REQUEST_TIMEOUT;
+
+      for (int i = 0; i < POOL_CONNECTIONS; i++) {
+         if (!clients_[i]->pollPipeline()) {
+            done    = false;
+            timeout = min(timeout, clients_[i]->getPipelineTimeout());
+         }
+      }
+      if (done) {
+         break;
+      }
+      waitReadable(timeout);
    }
-   return ret;
 }
 
 /* ***************************************************************************** */
@@ -229,6 +872,7 @@ public:
 
    bool getPlainValue(String &value, String topic);
    bool getPlainValue(double &value, String topic);
+   bool getTimestamp (DateTime &dateTime, String topic);
 };
 
 /* The request was started. */
@@ -249,7 +893,7 @@ bool IoBrokerPlain::getPlainValue(String &value, String topic)
    if (sendRequest(IOBROKER_GET_PLAIN, topic)) {
       value = plainString_;
       value = Trim(value, "\"");
-      Serial.println("   plainValue: " + value);
+      LOG_DEBUG("   plainValue: %s", value.c_str());
       return true;
    }
    return false;
@@ -261,7 +905,19 @@ bool IoBrokerPlain::getPlainValue(double &value, String topic)
    value = 0.0;
    if (sendRequest(IOBROKER_GET_PLAIN, topic)) {
       value = plainString_.toDouble();
-      Serial.println("   plainValue: " + String(value));
+      LOG_DEBUG("   plainValue: %f", value);
+      return true;
+   }
+   return false;
+}
+
+/* Read a UTC timestamp (seconds) and convert it to local time. */
+bool IoBrokerPlain::getTimestamp(DateTime &dateTime, String topic)
+{
+   double timestamp = 0.0;
+
+   if (getPlainValue(timestamp, topic) && timestamp > 0.0) {
+      dateTime = UtcToLocalTime((time_t) timestamp);
       return true;
    }
    return false;
@@ -290,6 +946,10 @@ public:
    }
 
    bool getLastChange(DateTime &dateTime, String topic);
+
+   void queueState   (String topic);
+   bool getStateTime (const char *key, time_t &time);
+   bool getStateValue(float &value);
 };
 
 /* The request was started. */
@@ -322,7 +982,7 @@ bool IoBrokerValue::getLastChange(DateTime &dateTime, String topic)
             String timestamp = jsonData_.substring(lcIndex + lcPart.length(), lcIndexEnd - 3); // no milliseconds
 
             dateTime = UtcToLocalTime(timestamp.toInt());
-            Serial.printf("   get lc: %d-%d-%d %d:%d:%d\n", dateTime.year(), dateTime.month(), dateTime.day(), dateTime.hour(), dateTime.minute(), dateTime.second());
+            LOG_DEBUG("   get lc: %d-%d-%d %d:%d:%d", dateTime.year(), dateTime.month(), dateTime.day(), dateTime.hour(), dateTime.minute(), dateTime.second());
             return true;
          }
       }
@@ -330,202 +990,1951 @@ bool IoBrokerValue::getLastChange(DateTime &dateTime, String topic)
    return false;
 }
 
+/* Queue the request of the complete state object into the pipeline. */
+void IoBrokerValue::queueState(String topic)
+{
+   wifiClient_.queueRequest(this, IOBROKER_GET + topic);
+}
+
+/* 
+ *  Read a timestamp (msec) of the received state object as UTC seconds.
+   { "val": 12.3, "ack": true, "ts": 1666000000123, "lc": 1665000000456, ... }
+   */
+bool IoBrokerValue::getStateTime(const char *key, time_t &time)
+{
+   String part  = "\"" + String(key) + "\":";
+   int    index = jsonData_.indexOf(part);
+
+   if (!received_ || index < 0) {
+      return false;
+   }
+   time = (time_t) (atoll(jsonData_.c_str() + index + part.length()) / 1000);
+   return time > 0;
+}
+
+/* Read the number value of the received state object, a string, boolean or null value fails. */
+bool IoBrokerValue::getStateValue(float &value)
+{
+   String      part  = "\"val\":";
+   int         index = jsonData_.indexOf(part);
+   const char *text;
+
+   if (!received_ || index < 0) {
+      return false;
+   }
+   text = jsonData_.c_str() + index + part.length();
+   if (!isdigit(*text) && *text != '-') {
+      return false;
+   }
+   value = atof(text);
+   return true;
+}
+
 /* ***************************************************************************** */
-/* *** class IoBrokerHistory ************************************************ */
+/* *** class IoBrokerBulk ****************************************************** */
 /* ***************************************************************************** */
 
 /**
-  * IoBroker History request.
+  * IoBroker bulk request: reads many states with one getBulk request.
+  * The json result is parsed char by char straight into the registered fields.
+    [{"id":"mqtt.0.bmv.CE","val":-1234,"ts":1666000000000,"ack":true}, ...]
+  * Missing states are read afterwards with the single state requests.
   */
-class IoBrokerHistory : public IoBrokerBase
+class IoBrokerBulk : public IoBrokerBase
 {
 protected:
-   HistoryData &historyData_;  //!< The history data of the last 4 weeks
-   float        factor_;       //!< Multiplication factor
-   int          days_;         //!< How many days we will show
-   DateTime     fromDate_;     //!< Start date for the request (4 weeks earlier)
-   DateTime     toDate_;       //!< End date, tomorrow
+   enum ITEM_TYPE { ITEM_DOUBLE, ITEM_STRING, ITEM_TIMESTAMP };
+   enum PARSE_STATE { PARSE_IDLE, PARSE_KEY_START, PARSE_KEY, PARSE_COLON, PARSE_VALUE_START, PARSE_STRING, PARSE_VALUE };
 
-   String       valueString_;  //!< Incommig data  
-   bool         valueStart_;   //!< One incomming data '[xxx, xxx]' has startet
+   /** One requested state */
+   struct Item
+   {
+      const char *topic;       //!< State id
+      ITEM_TYPE   type;        //!< Type of the value
+      void       *value;       //!< double, String or DateTime value
+      DateTime   *lastChange;  //!< Optional last change of the state ('ts')
+      float       scale;       //!< Multiplication factor of a double value
+      bool        received;    //!< State was part of the result
+   };
+
+   Item        items_[BULK_MAX_ITEMS];      //!< Requested states
+   int         count_;                      //!< Count of the requested states
+   int         objectIndex_;                //!< Index of the current result object
+
+   PARSE_STATE state_;                      //!< State of the json parser
+   int         depth_;                      //!< Depth of a skipped nested value
+   bool        escape_;                     //!< Last string char was a backslash
+   char        key_[BULK_KEY_SIZE];         //!< Current key
+   int         keyLen_;                     //!< Length of the current key
+   char        token_[BULK_TOKEN_SIZE];     //!< Current value
+   int         tokenLen_;                   //!< Length of the current value
+   char        id_[BULK_ID_SIZE];           //!< 'id' of the current object
+   char        val_[BULK_VALUE_SIZE];       //!< 'val' of the current object
+   bool        valIsNull_;                  //!< 'val' is null
+   char        ts_[BULK_VALUE_SIZE];        //!< 'ts' of the current object
 
 protected:
    virtual void onRequest ();
    virtual void onChar    (char c);
 
-   void parsValue(String valueString);
+   void add(const char *topic, ITEM_TYPE type, void *value, DateTime *lastChange, float scale = 1.0);
+   void applyValue(Item &item, const char *value, const DateTime *lastChange);
+   bool isOptional(const Item &item) { return item.type == ITEM_TIMESTAMP; }
+   void onValue();
+   void onObject();
+   void fallback();
 
 public:
-   enum HISTORY_TYPE { AVG, MAX } eHistoryType_;
-   
-public:
+   IoBrokerBulk(IoBrokerWifiClient &wifiClient)
+      : IoBrokerBase(wifiClient)
+      , count_(0)
+   {
+      onRequest();
+   }
+
+   void add         (double   &value,    const char *topic, DateTime *lastChange = NULL, float scale = 1.0);
+   void add         (String   &value,    const char *topic, DateTime *lastChange = NULL);
+   void addTimestamp(DateTime &dateTime, const char *topic);
+
+   bool setValue       (const char *id, const char *value, const DateTime *lastChange = NULL);
+   int  getMissingCount();
+   int  getCount       ();
+
+   void queueBulkValues ();
+   bool finishBulkValues();
+   bool getBulkValues   ();
+};
+
+/* Register one state. */
+void IoBrokerBulk::add(const char *topic, ITEM_TYPE type, void *value, DateTime *lastChange, float scale /*= 1.0*/)
+{
+   if (count_ < BULK_MAX_ITEMS) {
+      items_[count_].topic      = topic;
+      items_[count_].type       = type;
+      items_[count_].value      = value;
+      items_[count_].lastChange = lastChange;
+      items_[count_].scale      = scale;
+      items_[count_].received   = false;
+      count_++;
+   } else {
+      LOG_ERROR("IoBrokerBulk: too many items, %s ignored!", topic);
+   }
+}
+
+/* Register a double state with its optional last change and multiplication factor. */
+void IoBrokerBulk::add(double &value, const char *topic, DateTime *lastChange /*= NULL*/, float scale /*= 1.0*/)
+{
+   add(topic, ITEM_DOUBLE, &value, lastChange, scale);
+}
+
+/* Register a string state with its optional last change. */
+void IoBrokerBulk::add(String &value, const char *topic, DateTime *lastChange /*= NULL*/)
+{
+   add(topic, ITEM_STRING, &value, lastChange);
+}
+
+/* Register a state with a UTC timestamp (seconds), it is set only if the value is valid. */
+void IoBrokerBulk::addTimestamp(DateTime &dateTime, const char *topic)
+{
+   add(topic, ITEM_TIMESTAMP, &dateTime, NULL);
+}
+
+/* The request was started. */
+void IoBrokerBulk::onRequest()
+{
+   objectIndex_ = 0;
+   state_       = PARSE_IDLE;
+   depth_       = 0;
+   escape_      = false;
+   keyLen_      = 0;
+   tokenLen_    = 0;
+   id_[0]       = '\0';
+   val_[0]      = '\0';
+   valIsNull_   = true;
+   ts_[0]       = '\0';
+   for (int i = 0; i < count_; i++) {
+      items_[i].received = false;
+   }
+}
+
+/* One key value pair of the current object is complete. */
+void IoBrokerBulk::onValue()
+{
+   token_[tokenLen_] = '\0';
+   key_[keyLen_]     = '\0';
+
+   if (strcmp(key_, "id") == 0) {
+      strlcpy(id_, token_, sizeof(id_));
+   } else if (strcmp(key_, "val") == 0) {
+      strlcpy(val_, token_, sizeof(val_));
+      valIsNull_ = state_ == PARSE_VALUE && strcmp(token_, "null") == 0;
+   } else if (strcmp(key_, "ts") == 0) {
+      strlcpy(ts_, token_, sizeof(ts_));
+   }
+   keyLen_   = 0;
+   tokenLen_ = 0;
+}
+
+/* Store the value (NULL = null) and the optional last change into the registered fields. */
+void IoBrokerBulk::applyValue(Item &item, const char *value, const DateTime *lastChange)
+{
+   item.received = true;
+   if (item.type == ITEM_DOUBLE) {
+      *(double *) item.value = value ? atof(value) * item.scale : 0.0;
+   } else if (item.type == ITEM_STRING) {
+      *(String *) item.value = value ? value : "";
+   } else if (value && atof(value) > 0.0) { // ITEM_TIMESTAMP
+      *(DateTime *) item.value = UtcToLocalTime((time_t) atof(value));
+   }
+   if (item.lastChange && lastChange) {
+      *item.lastChange = *lastChange;
+   }
+}
+
+/* Store the value of a state by its id, returns false if the id is unknown or already set. */
+bool IoBrokerBulk::setValue(const char *id, const char *value, const DateTime *lastChange /*= NULL*/)
+{
+   for (int i = 0; i < count_; i++) {
+      if (!items_[i].received && strcmp(items_[i].topic, id) == 0) {
+         applyValue(items_[i], value, lastChange);
+         return true;
+      }
+   }
+   return false;
+}
+
+/* Count of the required states without a value, a timestamp may not exist on the bridge. */
+int IoBrokerBulk::getMissingCount()
+{
+   int missing = 0;
+
+   for (int i = 0; i < count_; i++) {
+      if (!items_[i].received && !isOptional(items_[i])) {
+         missing++;
+      }
+   }
+   return missing;
+}
+
+/* Count of the required states. */
+int IoBrokerBulk::getCount()
+{
+   int count = 0;
+
+   for (int i = 0; i < count_; i++) {
+      if (!isOptional(items_[i])) {
+         count++;
+      }
+   }
+   return count;
+}
+
+/* One result object is complete, store the values into the registered fields.
+   A null or not numeric 'ts' keeps the previous last change. */
+void IoBrokerBulk::onObject()
+{
+   const char *value         = valIsNull_ ? NULL : val_;
+   bool        hasLastChange = strlen(ts_) > 3 && strspn(ts_, "0123456789") == strlen(ts_);
+   DateTime    lastChange;
+
+   if (hasLastChange) {
+      ts_[strlen(ts_) - 3] = '\0'; // no milliseconds
+      lastChange = UtcToLocalTime(atol(ts_));
+   }
+
+   // Find the state by id, without id the results are in the request order.
+   if (id_[0] != '\0') {
+      setValue(id_, value, hasLastChange ? &lastChange : NULL);
+   } else if (objectIndex_ < count_) {
+      applyValue(items_[objectIndex_], value, hasLastChange ? &lastChange : NULL);
+   }
+   objectIndex_++;
+
+   id_[0]     = '\0';
+   val_[0]    = '\0';
+   valIsNull_ = true;
+   ts_[0]     = '\0';
+}
+
+/* one char comes in. */
+void IoBrokerBulk::onChar(char c)
+{
+   switch (state_) {
+      case PARSE_IDLE:
+         if (c == '{') {
+            state_ = PARSE_KEY_START;
+         }
+         break;
+      case PARSE_KEY_START:
+         if (c == '"') {
+            keyLen_ = 0;
+            state_  = PARSE_KEY;
+         } else if (c == '}') {
+            onObject();
+            state_ = PARSE_IDLE;
+         }
+         break;
+      case PARSE_KEY:
+         if (c == '"') {
+            state_ = PARSE_COLON;
+         } else if (keyLen_ < BULK_KEY_SIZE - 1) {
+            key_[keyLen_++] = c;
+         }
+         break;
+      case PARSE_COLON:
+         if (c == ':') {
+            tokenLen_ = 0;
+            depth_    = 0;
+            state_    = PARSE_VALUE_START;
+         }
+         break;
+      case PARSE_VALUE_START:
+         if (c == '"') {
+            escape_ = false;
+            state_  = PARSE_STRING;
+         } else if (!isspace(c)) {
+            state_ = PARSE_VALUE;
+            onChar(c);
+         }
+         break;
+      case PARSE_STRING:
+         if (escape_) {
+            escape_ = false;
+            if (tokenLen_ < BULK_TOKEN_SIZE - 1) {
+               token_[tokenLen_++] = c;
+            }
+         } else if (c == '\\') {
+            escape_ = true;
+         } else if (c == '"') {
+            onValue();
+            state_ = PARSE_KEY_START;
+         } else if (tokenLen_ < BULK_TOKEN_SIZE - 1) {
+            token_[tokenLen_++] = c;
+         }
+         break;
+      case PARSE_VALUE:
+         // Nested objects or arrays are skipped
+         if (c == '{' || c == '[') {
+            depth_++;
+         } else if ((c == '}' || c == ']') && depth_ > 0) {
+            depth_--;
+         } else if (depth_ == 0 && (c == ',' || c == '}')) {
+            onValue();
+            if (c == '}') {
+               onObject();
+               state_ = PARSE_IDLE;
+            } else {
+               state_ = PARSE_KEY_START;
+            }
+         } else if (depth_ == 0 && !isspace(c) && tokenLen_ < BULK_TOKEN_SIZE - 1) {
+            token_[tokenLen_++] = c;
+         }
+         break;
+   }
+}
+
+/* Read the states which are not part of the bulk result with single requests.
+   An optional state missing in a received bulk result does not exist, it is not requested again. */
+void IoBrokerBulk::fallback()
+{
+   IoBrokerPlain ioBrokerPlain(wifiClient_);
+   IoBrokerValue ioBrokerValue(wifiClient_);
+
+   for (int i = 0; i < count_; i++) {
+      Item &item = items_[i];
+
+      if (!item.received && !(received_ && isOptional(item))) {
+         if (item.type == ITEM_DOUBLE) {
+            item.received = ioBrokerPlain.getPlainValue(*(double *) item.value, item.topic);
+         } else if (item.type == ITEM_STRING) {
+            item.received = ioBrokerPlain.getPlainValue(*(String *) item.value, item.topic);
+         } else { // ITEM_TIMESTAMP
+            item.received = ioBrokerPlain.getTimestamp(*(DateTime *) item.value, item.topic);
+         }
+         if (item.lastChange) {
+            ioBrokerValue.getLastChange(*item.lastChange, item.topic);
+         }
+      }
+   }
+}
+
+/* Queue the request of all registered states into the pipeline. */
+void IoBrokerBulk::queueBulkValues()
+{
+   String topics;
+
+   for (int i = 0; i < count_; i++) {
+      if (i > 0) {
+         topics += ",";
+      }
+      topics += items_[i].topic;
+   }
+   wifiClient_.queueRequest(this, IOBROKER_GET_BULK + topics);
+}
+
+/* Check the result of the pipeline or the mqtt values, read the missing states with single requests. */
+bool IoBrokerBulk::finishBulkValues()
+{
+   int missing = getMissingCount();
+
+   LOG_INFO("IoBrokerBulk: %d of %d values", getCount() - missing, getCount());
+   if (missing > 0) {
+      fallback();
+      missing = getMissingCount();
+   }
+   return missing == 0;
+}
+
+/* Read all registered states with one request, the missing ones with single requests. */
+bool IoBrokerBulk::getBulkValues()
+{
+   queueBulkValues();
+   wifiClient_.sendPipeline();
+   return finishBulkValues();
+}
+
+/* ***************************************************************************** */
+/* *** class HistoryTokenizer ************************************************** */
+/* ***************************************************************************** */
+
+/**
+  * Push based tokenizer for the '[value, timestamp]' pairs of a history result.
+    [{"target":"mqtt.0.bmv.SOC","datapoints":[[955,1666000000000],[954,1666000060000], ...]}]
+  * The numbers are parsed straight from the byte stream with a fixed state, no Strings.
+  */
+class HistoryTokenizer
+{
+protected:
+   enum TOKEN_STATE { TOKEN_IDLE, TOKEN_VALUE, TOKEN_TIMESTAMP, TOKEN_END };
+
+   TOKEN_STATE state_;        //!< Current position in the pair
+   bool        negative_;     //!< Value has a minus sign
+   bool        fraction_;     //!< Behind the decimal point of the value
+   bool        exponent_;     //!< In the exponent of the value
+   bool        expNegative_;  //!< Exponent has a minus sign
+   bool        valid_;        //!< Value has at least one digit (not null)
+   int64_t     mantissa_;     //!< Digits of the value
+   int         scale_;        //!< Decimal scale of the mantissa
+   int         exp_;          //!< Exponent of the value
+   uint32_t    tsSeconds_;    //!< Timestamp without the last three digits (sec)
+   uint32_t    tsMillis_;     //!< Last three digits of the timestamp (msec)
+   int         tsDigits_;     //!< Count of the timestamp digits (0 = null)
+
+   float       value_;        //!< Value of the last complete pair
+   uint32_t    seconds_;      //!< Timestamp (sec) of the last complete pair
+
+protected:
+   void startPair();
+   void pushValue(char c);
+
+public:
+   HistoryTokenizer()
+   {
+      reset();
+   }
+
+   void     reset();
+   bool     push(char c);
+   float    getValue()     { return value_;   }
+   uint32_t getTimestamp() { return seconds_; }
+};
+
+/* Start a new result. */
+void HistoryTokenizer::reset()
+{
+   state_   = TOKEN_IDLE;
+   value_   = 0.0;
+   seconds_ = 0;
+}
+
+/* A '[' starts a new pair. */
+void HistoryTokenizer::startPair()
+{
+   state_       = TOKEN_VALUE;
+   negative_    = false;
+   fraction_    = false;
+   exponent_    = false;
+   expNegative_ = false;
+   valid_       = false;
+   mantissa_    = 0;
+   scale_       = 0;
+   exp_         = 0;
+   tsSeconds_   = 0;
+   tsMillis_    = 0;
+   tsDigits_    = 0;
+}
+
+/* One char of the value '-12.5e-1' */
+void HistoryTokenizer::pushValue(char c)
+{
+   if (c >= '0' && c <= '9') {
+      if (exponent_) {
+         exp_ = exp_ * 10 + (c - '0');
+      } else if (mantissa_ < 100000000000000000LL) {
+         mantissa_ = mantissa_ * 10 + (c - '0');
+         if (fraction_) {
+            scale_--;
+         }
+         valid_ = true;
+      } else if (!fraction_) {
+         scale_++; // too many digits, keep the magnitude
+      }
+   } else if (c == '-') {
+      if (exponent_) {
+         expNegative_ = true;
+      } else {
+         negative_ = true;
+      }
+   } else if (c == '.') {
+      fraction_ = true;
+   } else if (c == 'e' || c == 'E') {
+      exponent_ = true;
+   }
+   // ' ', '+' and the letters of 'null' are ignored
+}
+
+/* Push one char, returns true if a complete '[value, timestamp]' pair is available. */
+bool HistoryTokenizer::push(char c)
+{
+   if (c == '[') {
+      startPair();
+      return false;
+   }
+   switch (state_) {
+      case TOKEN_IDLE:
+         break;
+      case TOKEN_VALUE:
+         if (c == ',') {
+            state_ = TOKEN_TIMESTAMP;
+         } else if (c == ']' || c == '{' || c == '"') {
+            state_ = TOKEN_IDLE; // no pair
+         } else {
+            pushValue(c);
+         }
+         break;
+      case TOKEN_TIMESTAMP:
+         if (c >= '0' && c <= '9') {
+            // The digits pass a three digit delay line, so the msec never need a 64 bit division.
+            if (tsDigits_ >= 3) {
+               tsSeconds_ = tsSeconds_ * 10 + tsMillis_ / 100;
+            }
+            tsMillis_ = (tsMillis_ % 100) * 10 + (c - '0');
+            tsDigits_++;
+         } else if (c == ']') {
+            state_ = TOKEN_IDLE;
+            if (valid_ && tsDigits_ > 0) {
+               float value = (float) mantissa_;
+               int   scale = scale_ + (expNegative_ ? -exp_ : exp_);
+
+               for (; scale > 0; scale--) {
+                  value *= 10.0;
+               }
+               for (; scale < 0; scale++) {
+                  value /= 10.0;
+               }
+               value_   = negative_ ? -value : value;
+               seconds_ = tsSeconds_; // no milliseconds
+               return true;
+            }
+         } else if (c == ',') {
+            state_ = TOKEN_END; // more than two items, ignore the rest
+         }
+         break;
+      case TOKEN_END:
+         if (c == ']') {
+            state_ = TOKEN_IDLE;
+         }
+         break;
+   }
+   return false;
+}
+
+/* ***************************************************************************** */
+/* *** class HistoryAggregator ************************************************* */
+/* ***************************************************************************** */
+
+/**
+  * Bins the history points of one request into the buckets.
+  * The state of the buckets only lives during the request,
+  * the HistoryData keeps nothing but the final values.
+  */
+class HistoryAggregator
+{
+public:
+   virtual ~HistoryAggregator() {}
+
+   virtual void        begin (int count) = 0;
+   virtual void        add   (int bucket, float value) = 0;
+   virtual void        finish(HistoryData &historyData, int first, float factor) = 0;
+   virtual void        end   () = 0;
+   virtual const char *getServerAggregate() = 0;
+};
+
+/**
+  * Aggregator of one bucket policy. The policy defines the smallest state of a bucket:
+  *   State                state of one bucket
+  *   reset()              empty bucket
+  *   add()                combine one point into the bucket
+  *   isValid()            the bucket has a value
+  *   getValue()           value of the bucket, the upper edge of a band
+  *   getLow()             lower edge of a band
+  *   getServerAggregate() aggregate of the history adapter with the same result (NULL = raw points)
+  */
+template <class Policy>
+class BucketAggregator : public HistoryAggregator
+{
+protected:
+   typename Policy::State *states_; //!< Bucket states of the running request
+   int                     count_;  //!< Count of the requested buckets
+
+public:
+   BucketAggregator()
+      : states_(NULL)
+      , count_(0)
+   {
+   }
+   ~BucketAggregator()
+   {
+      end();
+   }
+
+   virtual void        begin (int count);
+   virtual void        add   (int bucket, float value);
+   virtual void        finish(HistoryData &historyData, int first, float factor);
+   virtual void        end   ();
+   virtual const char *getServerAggregate() { return Policy::getServerAggregate(); }
+};
+
+/* Allocate and reset the states of 'count' buckets. */
+template <class Policy>
+void BucketAggregator<Policy>::begin(int count)
+{
+   end();
+   states_ = new typename Policy::State[count];
+   count_  = count;
+   for (int i = 0; i < count_; i++) {
+      Policy::reset(states_[i]);
+   }
+}
+
+/* Combine one point into the bucket, 0 is the first requested one. */
+template <class Policy>
+void BucketAggregator<Policy>::add(int bucket, float value)
+{
+   if (bucket >= 0 && bucket < count_) {
+      Policy::add(states_[bucket], value);
+   }
+}
+
+/* Write the buckets with a value to the history from index 'first' and free the states. */
+template <class Policy>
+void BucketAggregator<Policy>::finish(HistoryData &historyData, int first, float factor)
+{
+   for (int i = 0; i < count_ && first + i < historyData.size_; i++) {
+      if (Policy::isValid(states_[i])) {
+         historyData.setValue(first + i, factor * Policy::getValue(states_[i]));
+         historyData.setLow  (first + i, factor * Policy::getLow  (states_[i]));
+      }
+   }
+   end();
+}
+
+/* Free the states. */
+template <class Policy>
+void BucketAggregator<Policy>::end()
+{
+   delete [] states_;
+   states_ = NULL;
+   count_  = 0;
+}
+
+/** Mean of the points */
+struct AvgPolicy
+{
+   struct State { float sum; uint32_t count; };
+
+   static void        reset   (State &s)          { s.sum = 0.0; s.count = 0; }
+   static void        add     (State &s, float v) { s.sum += v; s.count++; }
+   static bool        isValid (const State &s)    { return s.count > 0; }
+   static float       getValue(const State &s)    { return s.sum / s.count; }
+   static float       getLow  (const State &s)    { return getValue(s); }
+   static const char *getServerAggregate()        { return "average"; }
+};
+
+/** Highest point */
+struct MaxPolicy
+{
+   struct State { float max; };
+
+   static void        reset   (State &s)          { s.max = -INFINITY; }
+   static void        add     (State &s, float v) { if (v > s.max) s.max = v; }
+   static bool        isValid (const State &s)    { return s.max != -INFINITY; }
+   static float       getValue(const State &s)    { return s.max; }
+   static float       getLow  (const State &s)    { return s.max; }
+   static const char *getServerAggregate()        { return "max"; }
+};
+
+/** Lowest point */
+struct MinPolicy
+{
+   struct State { float min; };
+
+   static void        reset   (State &s)          { s.min = INFINITY; }
+   static void        add     (State &s, float v) { if (v < s.min) s.min = v; }
+   static bool        isValid (const State &s)    { return s.min != INFINITY; }
+   static float       getValue(const State &s)    { return s.min; }
+   static float       getLow  (const State &s)    { return s.min; }
+   static const char *getServerAggregate()        { return "min"; }
+};
+
+/** Newest point, the adapter sends the points sorted by time */
+struct LastPolicy
+{
+   struct State { float last; };
+
+   static void        reset   (State &s)          { s.last = NAN; }
+   static void        add     (State &s, float v) { s.last = v; }
+   static bool        isValid (const State &s)    { return !isnan(s.last); }
+   static float       getValue(const State &s)    { return s.last; }
+   static float       getLow  (const State &s)    { return s.last; }
+   static const char *getServerAggregate()        { return NULL; } // no such aggregate, raw points
+};
+
+/** Sum of the points */
+struct SumPolicy
+{
+   struct State { float sum; };
+
+   static void        reset   (State &s)          { s.sum = 0.0; }
+   static void        add     (State &s, float v) { s.sum += v; }
+   static bool        isValid (const State &)     { return true; }
+   static float       getValue(const State &s)    { return s.sum; }
+   static float       getLow  (const State &s)    { return s.sum; }
+   static const char *getServerAggregate()        { return "total"; }
+};
+
+/** Lowest and highest point, the envelope of a band history */
+struct MinMaxPolicy
+{
+   struct State { float min; float max; };
+
+   static void        reset   (State &s)          { s.min = INFINITY; s.max = -INFINITY; }
+   static void        add     (State &s, float v) { if (v < s.min) s.min = v; if (v > s.max) s.max = v; }
+   static bool        isValid (const State &s)    { return s.max != -INFINITY; }
+   static float       getValue(const State &s)    { return s.max; }
+   static float       getLow  (const State &s)    { return s.min; }
+   static const char *getServerAggregate()        { return "minmax"; }
+};
+
+/* ***************************************************************************** */
+/* *** class IoBrokerHistory ************************************************ */
+/* ***************************************************************************** */
+
+/**
+  * IoBroker History request.
+  */
+class IoBrokerHistory : public IoBrokerBase
+{
+protected:
+   HistoryData      &historyData_;  //!< The history data of the last 4 weeks
+   float             factor_;       //!< Multiplication factor
+   int               days_;         //!< How many days we will show
+   DateTime          fromDate_;     //!< Start date for the request (4 weeks earlier)
+   DateTime          toDate_;       //!< End date, tomorrow
+
+   HistoryTokenizer  tokenizer_;    //!< Parser of the incomming data
+   HistoryAggregator *aggregator_;  //!< Binning of the points into the buckets
+   EnergyCounter    *energy_;       //!< Integration of the points (NULL = none)
+   int               points_;       //!< Count of the received points
+   String            topic_;        //!< Topic of the queued request
+   int               first_;        //!< First requested bucket, the older ones are cached
+   int               last_;         //!< End of the requested buckets (exclusive), the newer ones are in a finer history
+   bool              aggregated_;   //!< The queued request is aggregated by the server
+   time_t            stateChange_;  //!< Last change of the state before the request (0 = unknown)
+   bool              skipped_;      //!< The state is unchanged, the stored history is up to date
+   uint32_t          span_;         //!< Seconds of all buckets
+   uint64_t          reciprocal_;   //!< Fixed point reciprocal of the bucket width (2^HISTORY_RECIPROCAL_SHIFT / step, 0 = divide)
+
+   static bool       aggregateSupported_; //!< Server side aggregation works
+
+protected:
+   virtual void onRequest ();
+   virtual void onChar    (char c);
+
+   void   parsValue    (float value, uint32_t timestamp);
+   String getQueryParam(bool aggregate);
+
+public:
+   enum HISTORY_TYPE { AVG, MAX, MIN, LAST, SUM, MINMAX } eHistoryType_;
+
+   static HistoryAggregator *createAggregator(HISTORY_TYPE eHistoryType);
+   static uint64_t           getReciprocal   (int step, uint32_t span);
+   static int                getBucket       (uint32_t offset, int step, uint64_t reciprocal);
+   
+public:
    IoBrokerHistory(IoBrokerWifiClient &wifiClient, HistoryData &historyData, float factor, int days, HISTORY_TYPE eHistoryType)
       : IoBrokerBase(wifiClient)
-      , historyData_(historyData)
+      , historyData_(historyData)
+      , factor_(factor)
+      , days_(days)
+      , aggregator_(createAggregator(eHistoryType))
+      , energy_(NULL)
+      , points_(0)
+      , first_(0)
+      , last_(0)
+      , aggregated_(false)
+      , stateChange_(0)
+      , skipped_(false)
+      , span_(0)
+      , reciprocal_(0)
+      , eHistoryType_(eHistoryType)
+   {
+   }
+   ~IoBrokerHistory()
+   {
+      delete aggregator_;
+   }
+
+   String getFileName (String topic);
+   bool   isSkipped   () { return skipped_; }
+   bool   isAggregated() { return aggregated_; }
+   bool   isUnchanged () { return stateChange_ > 0 && historyData_.lastChange_ > 0 && stateChange_ <= historyData_.lastChange_; }
+   void   setEnergy   (EnergyCounter *energy) { energy_ = energy; }
+
+   void prepareHistoryValues(String topic);
+   bool queueHistoryRequest (time_t stateChange = 0, time_t covered = 0);
+   void fillUnchanged       (time_t until, float value);
+   void queueHistoryValues  (String topic);
+   bool finishHistoryValues ();
+   bool getHistoryValues   (String topic);
+};
+
+bool IoBrokerHistory::aggregateSupported_ = true;
+
+/* Create the aggregator of the history type. */
+HistoryAggregator *IoBrokerHistory::createAggregator(HISTORY_TYPE eHistoryType)
+{
+   switch (eHistoryType) {
+      case MAX:    return new BucketAggregator<MaxPolicy>();
+      case MIN:    return new BucketAggregator<MinPolicy>();
+      case LAST:   return new BucketAggregator<LastPolicy>();
+      case SUM:    return new BucketAggregator<SumPolicy>();
+      case MINMAX: return new BucketAggregator<MinMaxPolicy>();
+      default:     return new BucketAggregator<AvgPolicy>();
+   }
+}
+
+/* 
+ * Fixed point reciprocal of the bucket width, rounded up. It is exact for offset * step < 2^52.
+ * Returns 0 if this does not hold for every offset of the span or the product overflows.
+ */
+uint64_t IoBrokerHistory::getReciprocal(int step, uint32_t span)
+{
+   uint64_t reciprocal = ((1ULL << HISTORY_RECIPROCAL_SHIFT) + step - 1) / step;
+
+   if ((uint64_t) span * step >= (1ULL << HISTORY_RECIPROCAL_SHIFT) || reciprocal > UINT64_MAX / span) {
+      return 0;
+   }
+   return reciprocal;
+}
+
+/* Index of the bucket of the offset to the start of the timeline, without a reciprocal (0) it is divided. */
+int IoBrokerHistory::getBucket(uint32_t offset, int step, uint64_t reciprocal)
+{
+   return reciprocal > 0 ? (int) (((uint64_t) offset * reciprocal) >> HISTORY_RECIPROCAL_SHIFT)
+                         : (int) (offset / (uint32_t) step);
+}
+
+/* The request has started. */
+void IoBrokerHistory::onRequest()
+{
+   tokenizer_.reset();
+   historyData_.clearFrom(first_);
+   aggregator_->begin(historyData_.size_ - first_);
+   points_ = 0;
+}
+
+/* Push every char into the tokenizer and bin every complete data item. */
+void IoBrokerHistory::onChar(char c)
+{
+   if (tokenizer_.push(c)) {
+      parsValue(tokenizer_.getValue(), tokenizer_.getTimestamp());
+   }
+}
+
+/* 
+ * Bin one history data item. 'value, timestamp'
+ * The bucket index is found with integer seconds and the precomputed reciprocal of the
+ * bucket width, no DateTime and no (soft float) double division for every point.
+ */
+void IoBrokerHistory::parsValue(float value, uint32_t timestamp)
+{
+   uint32_t offset = timestamp - (uint32_t) historyData_.start_; // an older point wraps around
+
+   if (offset < span_) {
+      int historyIndex = getBucket(offset, historyData_.step_, reciprocal_);
+
+      points_++;
+      if (historyData_.lastFetched_ < timestamp) {
+         historyData_.lastFetched_ = timestamp;
+      }
+      aggregator_->add(historyIndex - first_, value);
+      if (energy_ && !aggregated_) {
+         energy_->add(timestamp, value * factor_);
+      }
+   } else {
+      DateTime jsonDate(timestamp);
+
+      LOG_DEBUG("Wrong history timestamp! [%f] Timestamp: %d-%d-%d %d:%d:%d", value, jsonDate.year(), jsonDate.month(), jsonDate.day(), jsonDate.hour(), jsonDate.minute(), jsonDate.second());
+   }
+}
+
+/* Name of the history file of the topic and the bucket width in the flash file system. */
+String IoBrokerHistory::getFileName(String topic)
+{
+   uint32_t hash = 2166136261UL; // FNV-1a, SPIFFS names are limited to 31 chars
+   char     fileName[24];
+
+   for (unsigned int i = 0; i < topic.length(); i++) {
+      hash = (hash ^ (uint8_t) topic[i]) * 16777619UL;
+   }
+   snprintf(fileName, sizeof(fileName), "/h%08x_%d.bin", hash, days_ * 24 * 60 * 60 / historyData_.size_);
+   return fileName;
+}
+
+/* Url parameters of the request from bucket 'first_' to bucket 'last_'. */
+String IoBrokerHistory::getQueryParam(bool aggregate)
+{
+   DateTime    dateFrom(fromDate_.unixtime() + (uint32_t) first_ * historyData_.step_);
+   DateTime    dateTo  (fromDate_.unixtime() + (uint32_t) last_  * historyData_.step_);
+   String      param           = "?dateFrom=" + getIoBrokerDateTimeString(dateFrom) +
+                                 "&dateTo="   + getIoBrokerDateTimeString(dateTo);
+   const char *serverAggregate = aggregator_->getServerAggregate();
+
+   if (aggregate && serverAggregate) {
+      return param + "&aggregate=" + serverAggregate +
+                     "&count="     + String(last_ - first_);
+   }
+   return param + "&count=" + String(HISTORY_RAW_COUNT);
+}
+
+/* 
+ * Prepare the history of one mqtt type for its request.
+ * The history of the last wake is loaded from the flash, shifted to the current
+ * time window and only the buckets since the newest stored timestamp are requested.
+ * The history adapter aggregates the values into exactly one point per history bucket.
+ */
+void IoBrokerHistory::prepareHistoryValues(String topic)
+{
+   int    step   = days_ * 24 * 60 * 60 / historyData_.size_;
+   time_t toTime = (time_t) GetRTCTime() + 3 * 60 * 60;
+   time_t end    = (toTime / step + 1) * step;
+   time_t start  = end - (time_t) step * historyData_.size_;
+
+   topic_      = topic;
+   first_      = 0;
+   last_       = historyData_.size_;
+   aggregated_ = aggregateSupported_ && aggregator_->getServerAggregate();
+
+   // Calculate the aligned from and to dates (4 weeks ago and tomorrow).
+   fromDate_ = DateTime((uint32_t) start);
+   toDate_   = DateTime((uint32_t) end);
+
+   // Reuse the stored buckets of the last wake.
+   if (StartStorage() && historyData_.load(getFileName(topic_)) &&
+       historyData_.step_ == step && historyData_.lastFetched_ > 0 && start >= historyData_.start_) {
+      historyData_.shift((start - historyData_.start_) / step);
+      if (historyData_.lastFetched_ > start) {
+         first_ = (historyData_.lastFetched_ - start) / step;
+      }
+      if (first_ >= historyData_.size_) {
+         first_ = historyData_.size_ - 1;
+      }
+   } else {
+      historyData_.clear();
+   }
+   historyData_.setTimeline(start, step);
+   span_       = (uint32_t) step * historyData_.size_;
+   reciprocal_ = getReciprocal(step, span_);
+   LOG_DEBUG("IoBrokerHistory: %d of %d buckets cached", first_, historyData_.size_);
+}
+
+/* 
+ * Queue the request of the prepared history into the pipeline. It is skipped if
+ * the stored history was read after the last change of the state ('lc', 0 = unknown),
+ * the history adapter has no new points then. It is skipped too if the new buckets
+ * start after 'covered' (0 = nothing), a finer history has these data, otherwise
+ * the request ends there.
+ * The points of a short range are requested raw if they are integrated into energy,
+ * the buckets are aggregated on the device then. The aggregated points of a longer
+ * range are not integrated, they are no samples of the power.
+ * Returns false if the request is skipped.
+ */
+bool IoBrokerHistory::queueHistoryRequest(time_t stateChange /*= 0*/, time_t covered /*= 0*/)
+{
+   stateChange_ = stateChange;
+   skipped_     = isUnchanged();
+   if (skipped_) {
+      LOG_DEBUG("IoBrokerHistory: %s unchanged, no request", topic_.c_str());
+      return false;
+   }
+   skipped_ = covered > 0 && (time_t) fromDate_.unixtime() + (time_t) first_ * historyData_.step_ >= covered;
+   if (skipped_) {
+      return false;
+   }
+   if (covered > 0) {
+      // The request ends with the bucket of the start of the finer history.
+      last_ = min(historyData_.size_, (int) ((covered - (time_t) fromDate_.unixtime() + historyData_.step_ - 1) / historyData_.step_));
+   }
+   if (energy_ && (time_t) (last_ - first_) * historyData_.step_ <= HISTORY_ENERGY_RANGE) {
+      aggregated_ = false;
+   }
+   wifiClient_.queueRequest(this, IOBROKER_QUERY + topic_ + getQueryParam(aggregated_));
+   return true;
+}
+
+/* 
+ * The state is unchanged since the stored history was read, so the history adapter
+ * has no new points. The buckets after the last fetched one up to 'until' (the last
+ * update of the state) are filled with its value and the watermark is moved there.
+ * A sum has no points in these buckets, only the watermark moves.
+ */
+void IoBrokerHistory::fillUnchanged(time_t until, float value)
+{
+   time_t from = historyData_.lastFetched_;
+
+   if (until <= from || until < historyData_.start_) {
+      return;
+   }
+   if (eHistoryType_ != SUM) {
+      int first = from >= historyData_.start_ ? (from - historyData_.start_) / historyData_.step_ + 1 : 0;
+      int last  = min((int) ((until - historyData_.start_) / historyData_.step_), historyData_.size_ - 1);
+
+      if (first <= last) {
+         aggregator_->begin(last - first + 1);
+         for (int i = 0; i <= last - first; i++) {
+            aggregator_->add(i, value);
+         }
+         aggregator_->finish(historyData_, first, factor_);
+      }
+   }
+   if (energy_) {
+      energy_->add(until, value * factor_);
+   }
+   historyData_.lastFetched_ = until;
+}
+
+/* Prepare the history of one mqtt type and queue its request into the pipeline. */
+void IoBrokerHistory::queueHistoryValues(String topic)
+{
+   prepareHistoryValues(topic);
+   queueHistoryRequest();
+}
+
+/* 
+ * Check the result of the pipeline. If the aggregation fails all raw points
+ * are requested and binned here. The aggregator writes the new buckets and
+ * the history is stored for the next wake.
+ */
+bool IoBrokerHistory::finishHistoryValues()
+{
+   bool ret = received_;
+
+   if (skipped_) {
+      // The cached buckets are complete, nothing is written to the flash.
+      historyData_.updateMax();
+      historyData_.stale_ = false;
+      return true;
+   }
+   // A cut response is no reason to give up the aggregation.
+   if (aggregated_ && http_.isDone() && (!ret || points_ == 0)) {
+      LOG_INFO("IoBrokerHistory: no aggregated data, use raw values!");
+      aggregateSupported_ = false;
+      ret = sendRequest(IOBROKER_QUERY, topic_, getQueryParam(false));
+   }
+
+   if (ret) {
+      aggregator_->finish(historyData_, first_, factor_);
+      historyData_.updateMax();
+      historyData_.lastChange_ = stateChange_;
+      if (StartStorage()) {
+         historyData_.save(getFileName(topic_));
+      }
+      historyData_.stale_ = false;
+      return true;
+   }
+
+   // Show the stored data of the last wake.
+   aggregator_->end();
+   historyData_.updateMax();
+   historyData_.stale_ = true;
+   return false;
+}
+
+/* Read the history data of one mqtt type. */
+bool IoBrokerHistory::getHistoryValues(String topic)
+{
+   queueHistoryValues(topic);
+   wifiClient_.sendPipeline();
+   return finishHistoryValues();
+}
+
+/* ***************************************************************************** */
+/* *** class IoBrokerEnergy **************************************************** */
+/* ***************************************************************************** */
+
+/**
+  * Raw history request of a power state which is only integrated into energy:
+  * a power without a displayed history or the long range of an aggregated one.
+  * Only the points since the last integrated one are requested, at most the
+  * hours of the counter.
+  */
+class IoBrokerEnergy : public IoBrokerBase
+{
+protected:
+   EnergyCounter    &counter_;   //!< Integration of the points
+   float             factor_;    //!< Multiplication factor
+   String            topic_;     //!< State id of the power
+   HistoryTokenizer  tokenizer_; //!< Parser of the incomming data
+   time_t            end_;       //!< End of the requested time
+
+protected:
+   virtual void onRequest();
+   virtual void onChar   (char c);
+
+public:
+   IoBrokerEnergy(IoBrokerWifiClient &wifiClient, EnergyCounter &counter, String topic, float factor)
+      : IoBrokerBase(wifiClient)
+      , counter_(counter)
       , factor_(factor)
-      , days_(days)
-      , valueStart_(false)
-      , eHistoryType_(eHistoryType)
-   {
-   }
-   ~IoBrokerHistory()
+      , topic_(topic)
+      , end_(0)
    {
    }
 
-   bool getHistoryValues(String topic);
+   void prepare     ();
+   void queueRequest();
+   bool finish      ();
 };
 
 /* The request has started. */
-void IoBrokerHistory::onRequest()
+void IoBrokerEnergy::onRequest()
 {
-   valueString_ = "";
+   tokenizer_.reset();
 }
 
-/* Add every char to the valueString and start parsing at the end of one data item. */
-void IoBrokerHistory::onChar(char c)
+/* Push every char into the tokenizer and integrate every complete data item. */
+void IoBrokerEnergy::onChar(char c)
 {
-   if (c == '[') {
-      valueStart_  = true;
-      valueString_ = "";
-   } else if (c == ']') {
-      valueStart_ = false;
-      // Serial.println("valueString: " + valueString_);
-      parsValue(valueString_);
-      valueString_ = "";
-   } else {
-      valueString_ += c;
+   if (tokenizer_.push(c)) {
+      counter_.add(tokenizer_.getTimestamp(), tokenizer_.getValue() * factor_);
    }
 }
 
-/* Pars one history data string. 'value, timestamp' */
-void IoBrokerHistory::parsValue(String valueString)
+/* Move the counter to the current time. */
+void IoBrokerEnergy::prepare()
 {
-   if  (valueString.length() >= 0) {
-      if (isDigit(valueString[0])) {
-         int sep = valueString.indexOf(',');
+   end_ = (time_t) GetRTCTime() + 3 * 60 * 60; // same end as the history requests
+   counter_.begin(end_);
+}
 
-         if (sep >= 0) {
-            String value     = valueString.substring(0, sep);
-            String timestamp = valueString.substring(sep + 1, valueString.length() - 3); // no milliseconds
+/* Queue the request of the points since the last integrated one into the pipeline. */
+void IoBrokerEnergy::queueRequest()
+{
+   time_t from = end_ - (time_t) ENERGY_HOURS * 60 * 60;
 
-            if (value != "null" && timestamp != "null") {
-               DateTime jsonDate(timestamp.toInt());
-   
-               int historyIndex = (double) historyData_.size_ / (double) (toDate_.secondstime() - fromDate_.secondstime()) * (double) (jsonDate.secondstime() - fromDate_.secondstime());
-   
-               if (historyIndex >= 0 && historyIndex < historyData_.size_) {
-                  if (historyData_.max_ < value.toFloat() * factor_) {
-                     historyData_.max_ = value.toFloat() * factor_;
-                  }
-                  if (eHistoryType_ == AVG) {
-                     historyData_.values_[historyIndex] += value.toFloat();
-                     historyData_.counts_[historyIndex]++;
-                  } else { // MAX
-                     if (value.toFloat() > historyData_.values_[historyIndex]) {
-                        historyData_.values_[historyIndex] = value.toFloat();
-                     }
-                     historyData_.counts_[historyIndex] = 1;
-                  }
-               } else {
-                  Serial.printf("\nWrong history index! [%d] [%f] Timestamp: %d-%d-%d %d:%d:%d\n", historyIndex, value.toFloat(), jsonDate.year(), jsonDate.month(), jsonDate.day(), jsonDate.hour(), jsonDate.minute(), jsonDate.second());
-               }
-               // Serial.printf("**** Index: %d Value: %f Timestamp: %d-%d-%d %d:%d:%d\n", historyIndex, value.toFloat(), jsonDate.year(), jsonDate.month(), jsonDate.day(), jsonDate.hour(), jsonDate.minute(), jsonDate.second());
+   if (counter_.lastTime_ > from) {
+      from = counter_.lastTime_;
+   }
+   wifiClient_.queueRequest(this, IOBROKER_QUERY + topic_ +
+                                  "?dateFrom=" + getIoBrokerDateTimeString(DateTime((uint32_t) from)) +
+                                  "&dateTo="   + getIoBrokerDateTimeString(DateTime((uint32_t) end_)) +
+                                  "&count="    + String(HISTORY_RAW_COUNT));
+}
+
+/* Book the integrated energy. Returns false if the request failed, the next wake continues at the last point. */
+bool IoBrokerEnergy::finish()
+{
+   counter_.finish();
+   if (!received_) {
+      LOG_ERROR("IoBrokerEnergy: %s failed!", topic_.c_str());
+   }
+   return received_;
+}
+
+/* ***************************************************************************** */
+/* *** class HistoryArchive **************************************************** */
+/* ***************************************************************************** */
+
+/** One resolution of the history archive */
+struct HistoryTier
+{
+   int step; //!< Seconds of one bucket
+   int days; //!< Time span of the tier
+};
+
+/** Resolutions of the history archive, the finest first */
+const HistoryTier HISTORY_TIERS[HISTORY_TIER_COUNT] = {
+   {       5 * 60,   2 }, // 5 minutes for 2 days
+   {      30 * 60,  21 }, // 30 minutes for 3 weeks
+   { 24 * 60 * 60, 366 }, // 1 day for a year
+};
+
+/**
+  * Round robin archive of one history in several resolutions (tiers).
+  * Every tier is stored in the flash and only its new buckets are requested.
+  * A coarser tier is only requested for the time before the finer one (first
+  * start or a long offline time), the newer buckets are consolidated from the
+  * finer tier on the device. The displayed history is resampled from the
+  * finest tier which has the data of each of its buckets.
+  * The raw points of the finest tier can be integrated into an EnergyCounter,
+  * an aggregated request of it is completed by a raw IoBrokerEnergy request.
+  */
+class HistoryArchive
+{
+protected:
+   IoBrokerWifiClient            &wifiClient_;                   //!< Pipeline of the requests
+   HistoryData                   &view_;                         //!< The displayed history
+   int                            days_;                         //!< Days of the displayed history
+   String                         topic_;                        //!< State id of the history
+   IoBrokerHistory::HISTORY_TYPE  eHistoryType_;                 //!< Aggregation of the buckets
+   float                          factor_;                       //!< Multiplication factor
+   HistoryData                   *tiers_[HISTORY_TIER_COUNT];    //!< The stored resolutions, the finest first
+   IoBrokerHistory               *requests_[HISTORY_TIER_COUNT]; //!< Update requests of the tiers
+   EnergyCounter                 *energy_;                       //!< Integration of the finest tier (NULL = none)
+   IoBrokerEnergy                *energyRequest_;                //!< Raw points of the counter (NULL = none)
+   bool                           energyQueued_;                 //!< The finest tier is aggregated, the raw points are requested
+
+protected:
+   void consolidate(HistoryData &target, HistoryData &source);
+   int  findTier   (time_t from);
+
+public:
+   HistoryArchive(IoBrokerWifiClient &wifiClient, HistoryData &view, String topic, float factor, int days, IoBrokerHistory::HISTORY_TYPE eHistoryType);
+   ~HistoryArchive();
+
+   void setEnergy    (EnergyCounter *energy);
+   void prepare      ();
+   int  queueRequests(IoBrokerValue &state);
+   bool finish       ();
+   void render       ();
+};
+
+HistoryArchive::HistoryArchive(IoBrokerWifiClient &wifiClient, HistoryData &view, String topic, float factor, int days, IoBrokerHistory::HISTORY_TYPE eHistoryType)
+   : wifiClient_(wifiClient)
+   , view_(view)
+   , days_(days)
+   , topic_(topic)
+   , eHistoryType_(eHistoryType)
+   , factor_(factor)
+   , energy_(NULL)
+   , energyRequest_(NULL)
+   , energyQueued_(false)
+{
+   for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+      int size = HISTORY_TIERS[i].days * 24 * 60 * 60 / HISTORY_TIERS[i].step;
+
+      tiers_[i]    = new HistoryData(size, view_.unitName_, view_.scale_, view_.isBand());
+      requests_[i] = new IoBrokerHistory(wifiClient, *tiers_[i], factor, HISTORY_TIERS[i].days, eHistoryType_);
+   }
+}
+
+HistoryArchive::~HistoryArchive()
+{
+   for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+      delete requests_[i];
+      delete tiers_[i];
+   }
+   delete energyRequest_;
+}
+
+/* Integrate the raw points of the finest tier into the counter. */
+void HistoryArchive::setEnergy(EnergyCounter *energy)
+{
+   energy_ = energy;
+   requests_[0]->setEnergy(energy);
+   delete energyRequest_;
+   energyRequest_ = energy ? new IoBrokerEnergy(wifiClient_, *energy, topic_, factor_) : NULL;
+}
+
+/* Load the stored tiers and shift them to the current time. */
+void HistoryArchive::prepare()
+{
+   for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+      requests_[i]->prepareHistoryValues(topic_);
+   }
+   if (energyRequest_) {
+      energyRequest_->prepare();
+   }
+   energyQueued_ = false;
+}
+
+/* 
+ * Queue the requests of the tiers which are not covered by a finer one, the received
+ * state object tells the last change. A tier of an unchanged state is filled up to the
+ * last update of the state. If the finest tier is aggregated the raw points of the
+ * EnergyCounter are requested too. Returns the count of the requests.
+ */
+int HistoryArchive::queueRequests(IoBrokerValue &state)
+{
+   time_t stateChange = 0;
+   time_t stateTime   = 0;
+   float  stateValue  = 0.0;
+   bool   hasValue;
+   int    count       = 0;
+
+   state.getStateTime("lc", stateChange);
+   state.getStateTime("ts", stateTime);
+   hasValue = state.getStateValue(stateValue);
+   for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+      if (requests_[i]->queueHistoryRequest(stateChange, i > 0 ? tiers_[i - 1]->start_ : 0)) {
+         count++;
+      } else if (hasValue && requests_[i]->isUnchanged()) {
+         requests_[i]->fillUnchanged(stateTime, stateValue);
+      }
+   }
+   if (energyRequest_ && !requests_[0]->isSkipped() && requests_[0]->isAggregated()) {
+      energyRequest_->queueRequest();
+      energyQueued_ = true;
+      count++;
+   }
+   return count;
+}
+
+/* 
+ * Recalculate the buckets of the coarser tier from the finer one. Only the
+ * buckets which start inside the finer tier are changed, the older ones keep
+ * their stored values.
+ */
+void HistoryArchive::consolidate(HistoryData &target, HistoryData &source)
+{
+   HistoryAggregator *aggregator = IoBrokerHistory::createAggregator(eHistoryType_);
+   int                first      = 0;
+
+   if (source.start_ > target.start_) {
+      first = (source.start_ - target.start_ + target.step_ - 1) / target.step_;
+   }
+   if (first < target.size_) {
+      aggregator->begin(target.size_ - first);
+      for (int i = 0; i < source.size_; i++) {
+         time_t start = source.start_ + (time_t) i * source.step_;
+
+         if (start > source.lastFetched_) {
+            break;
+         }
+         if (start >= target.start_) {
+            int bucket = (start - target.start_) / target.step_ - first;
+
+            if (source.isBand()) {
+               aggregator->add(bucket, source.getLow(i));
             }
+            aggregator->add(bucket, source.getValue(i));
          }
       }
+      aggregator->finish(target, first, 1.0);
+   }
+   delete aggregator;
+
+   if (target.lastFetched_ < source.lastFetched_) {
+      target.lastFetched_ = source.lastFetched_;
    }
+   target.lastChange_ = source.lastChange_;
+   target.updateMax();
 }
 
-/* Read all the history data of one mqtt type. */
-bool IoBrokerHistory::getHistoryValues(String topic)
+/* 
+ * Finish the requests of the tiers. If a tier got new data the coarser ones are
+ * consolidated from it and stored. The days of the EnergyCounter before its
+ * first start are seeded from an average or a min/max history, at last the
+ * displayed history is filled.
+ * Returns false if the data of a tier are stale.
+ */
+bool HistoryArchive::finish()
 {
-   String   param;
-   DateTime toDay = GetRTCTime();
+   bool ret     = true;
+   bool updated = false;
+
+   for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+      if (!requests_[i]->finishHistoryValues()) {
+         ret = false;
+      } else if (!requests_[i]->isSkipped()) {
+         updated = true;
+      }
+   }
+   if (energyQueued_) {
+      energyRequest_->finish();
+   } else if (energy_) {
+      energy_->finish();
+   }
+   if (updated) {
+      for (int i = 1; i < HISTORY_TIER_COUNT; i++) {
+         if (!tiers_[i - 1]->stale_ && tiers_[i - 1]->lastFetched_ > 0) {
+            consolidate(*tiers_[i], *tiers_[i - 1]);
+            if (StartStorage()) {
+               tiers_[i]->save(requests_[i]->getFileName(topic_));
+            }
+         }
+      }
+   }
+   if (energy_ && (eHistoryType_ == IoBrokerHistory::AVG || eHistoryType_ == IoBrokerHistory::MINMAX)) {
+      // The days of the counter before its first start come from the finest tier which spans them.
+      // The buckets of a maximum or a minimum would overstate or understate them.
+      int seedTier = 0;
 
-   historyData_.clear();
+      while (seedTier < HISTORY_TIER_COUNT - 1 && HISTORY_TIERS[seedTier].days < ENERGY_DAYS) {
+         seedTier++;
+      }
+      energy_->seed(*tiers_[seedTier]);
+   }
+   render();
+   view_.stale_ = !ret;
+   return ret;
+}
 
-   // Calculate the from and to dates (4 weeks ago and tomorrow) and format these as a query param.
-   toDate_   = toDay   + TimeSpan(    0, 3, 0, 0);
-   fromDate_ = toDate_ - TimeSpan(days_, 0, 0, 0);
-   param     = "?dateFrom=" + getIoBrokerDateTimeString(fromDate_) +
-               "&dateTo="   + getIoBrokerDateTimeString(toDate_)   +
-               "&count="    + String(200000);
+/* Index of the finest tier with the data of the bucket which starts at 'from' (-1 = none). */
+int HistoryArchive::findTier(time_t from)
+{
+   for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+      HistoryData &tier = *tiers_[i];
 
-   // Initialize the right time to the array positions.
-   int fromUnixTime = fromDate_.unixtime();                    
-   int toUnixTime   = toDate_.unixtime();                    
-   for (int i = 0; i < historyData_.size_; i++) {
-      historyData_.dates_[i] = DateTime((int) ((float) fromUnixTime + i * (float) (toUnixTime - fromUnixTime) / (float) historyData_.size_));
+      if (tier.lastFetched_ > 0 && from >= tier.start_ && from <= tier.lastFetched_) {
+         return i;
+      }
    }
+   return -1;
+}
 
-   // Send request, pars on every date item internaly
-   if (sendRequest(IOBROKER_QUERY, topic, param)) {
-      // average on every data
-      for (int i = 0; i < historyData_.size_; i++) {
-         if (historyData_.counts_[i] > 0) {
-            historyData_.values_[i] = factor_ * historyData_.values_[i] / historyData_.counts_[i];
+/* 
+ * Fill the displayed history from the tiers. Every displayed bucket aggregates
+ * the buckets of the finest tier which has its data, a coarser tier only fills
+ * the older buckets before the finer one. The finer tier is condensed to the
+ * width of the graph, a coarser one is stretched.
+ */
+void HistoryArchive::render()
+{
+   HistoryData       &finest     = *tiers_[0];
+   int                step       = days_ * 24 * 60 * 60 / view_.size_;
+   time_t             end        = finest.start_ + (time_t) finest.size_ * finest.step_;
+   HistoryAggregator *aggregator = IoBrokerHistory::createAggregator(eHistoryType_);
+
+   view_.clear();
+   view_.setTimeline(end - (time_t) step * view_.size_, step);
+   aggregator->begin(view_.size_);
+   for (int i = 0; i < view_.size_; i++) {
+      time_t from  = view_.start_ + (time_t) i * step;
+      int    index = findTier(from);
+
+      if (index >= 0) {
+         HistoryData &tier  = *tiers_[index];
+         int          first = (from - tier.start_) / tier.step_;
+         int          last  = (from + step - 1 - tier.start_) / tier.step_;
+
+         for (int j = first; j <= last && j < tier.size_; j++) {
+            if (tier.start_ + (time_t) j * tier.step_ > tier.lastFetched_) {
+               break;
+            }
+            if (tier.isBand()) {
+               aggregator->add(i, tier.getLow(j));
+            }
+            aggregator->add(i, tier.getValue(j));
          }
       }
-      return true;
    }
-   
-   return false;
+   aggregator->finish(view_, 0, 1.0);
+   delete aggregator;
+
+   for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+      if (view_.lastFetched_ < tiers_[i]->lastFetched_) {
+         view_.lastFetched_ = tiers_[i]->lastFetched_;
+      }
+   }
+   view_.lastChange_ = finest.lastChange_;
+   view_.updateMax();
+}
+
+#if DATA_SOURCE == DATA_SOURCE_MQTT
+/* ***************************************************************************** */
+/* *** class MqttValues ******************************************************** */
+/* ***************************************************************************** */
+
+/**
+  * Reads the current values from the retained messages of the mqtt broker.
+  * The bridge publishes every ve.direct value retained, so all of them come in
+  * right after the subscription. The topics are mapped to the IoBroker ids of
+  * the bulk ('bmv/CE' -> 'mqtt.0.bmv.CE'), missing values are read by the bulk fallback.
+  */
+class MqttValues
+{
+protected:
+   IoBrokerBulk  &bulk_;       //!< Receiver of the values
+   WiFiClient     wifiClient_; //!< Connection to the broker
+   PubSubClient   mqttClient_; //!< MQTT client
+   int            messages_;   //!< Count of the received messages
+   unsigned long  lastMillis_; //!< Time of the last message
+
+protected:
+   void onMessage      (const char *topic, const byte *payload, unsigned int length);
+   void onTasmotaSensor(char *json);
+   bool waitReadable   (unsigned long startMillis);
+
+public:
+   MqttValues(IoBrokerBulk &bulk)
+      : bulk_(bulk)
+      , mqttClient_(wifiClient_)
+      , messages_(0)
+      , lastMillis_(0)
+   {
+   }
+
+   int getValues();
+};
+
+/* Map one retained message to the IoBroker id of the bulk. */
+void MqttValues::onMessage(const char *topic, const byte *payload, unsigned int length)
+{
+   char message[MQTT_BUFFER_SIZE];
+   char id[BULK_ID_SIZE];
+
+   messages_++;
+   lastMillis_ = millis();
+   if (length >= sizeof(message)) {
+      return;
+   }
+   memcpy(message, payload, length);
+   message[length] = '\0';
+
+   if (strcmp(topic, TASMOTA_SENSOR_TOPIC) == 0) {
+      onTasmotaSensor(message);
+   } else if (strcmp(topic, TASMOTA_LWT_TOPIC) == 0) {
+      bulk_.setValue(TASMOTA_IOBROKER_PREFIX "alive", strcmp(message, "Online") == 0 ? "true" : "false");
+   } else {
+      snprintf(id, sizeof(id), MQTT_IOBROKER_PREFIX "%s", topic);
+      for (char *p = id; *p; p++) {
+         if (*p == '/') {
+            *p = '.';
+         }
+      }
+      bulk_.setValue(id, message);
+   }
+}
+
+/* 
+ * Set all ENERGY values of the Tasmota SENSOR message, the 'Time' is the last change (local time).
+   {"Time":"2022-10-18T12:00:00","ENERGY":{"TotalStartTime":"...","Total":12.3,...,"Power":45,"Voltage":230,"Current":0.2}}
+ */
+void MqttValues::onTasmotaSensor(char *json)
+{
+   char     *time    = strstr(json, "\"Time\":\"");
+   char     *pos     = strstr(json, "\"ENERGY\":{");
+   char     *key     = NULL;
+   DateTime  lastChange;
+   bool      hasTime = false;
+   int       year, month, day, hour, minute, second;
+
+   if (time && sscanf(time + 8, "%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour, &minute, &second) == 6) {
+      lastChange = DateTime(year, month, day, hour, minute, second);
+      hasTime    = true;
+   }
+   if (!pos) {
+      return;
+   }
+   pos += strlen("\"ENERGY\":{");
+   while ((key = strchr(pos, '"')) != NULL) {
+      char *keyEnd = strchr(key + 1, '"');
+      char *value  = NULL;
+      char *valueEnd;
+      char  next;
+      char  id[BULK_ID_SIZE];
+
+      if (!keyEnd || keyEnd[1] != ':') {
+         break;
+      }
+      value = keyEnd + 2;
+      if (*value == '"') {
+         value++;
+         valueEnd = strchr(value, '"');
+         if (!valueEnd) {
+            break;
+         }
+         next = valueEnd[1];
+         pos  = valueEnd + 2;
+      } else {
+         valueEnd = value + strcspn(value, ",}");
+         next     = *valueEnd;
+         pos      = valueEnd + 1;
+      }
+      *keyEnd   = '\0';
+      *valueEnd = '\0';
+      snprintf(id, sizeof(id), TASMOTA_IOBROKER_PREFIX "ENERGY_%s", key + 1);
+      bulk_.setValue(id, value, hasTime ? &lastChange : NULL);
+      if (next != ',') {
+         break; // end of the ENERGY object
+      }
+   }
+}
+
+/* 
+ * Sleep in select() until the broker socket is readable or the collect/quiet time ends.
+ * Returns false on timeout.
+ */
+bool MqttValues::waitReadable(unsigned long startMillis)
+{
+   int            fd      = wifiClient_.fd();
+   unsigned long  now     = millis();
+   unsigned long  timeout = MQTT_QUIET_TIME - (now - lastMillis_);
+   fd_set         readSet;
+   struct timeval tv;
+
+   if (fd < 0 || now - startMillis >= MQTT_COLLECT_TIMEOUT || now - lastMillis_ >= MQTT_QUIET_TIME) {
+      return false;
+   }
+   if (timeout > MQTT_COLLECT_TIMEOUT - (now - startMillis)) {
+      timeout = MQTT_COLLECT_TIMEOUT - (now - startMillis);
+   }
+   FD_ZERO(&readSet);
+   FD_SET(fd, &readSet);
+   tv.tv_sec  = timeout / 1000;
+   tv.tv_usec = (timeout % 1000) * 1000;
+   return select(fd + 1, &readSet, NULL, NULL, &tv) > 0;
+}
+
+/* 
+ * Connect to the broker, collect the retained messages and disconnect.
+ * Stops if all values are set, no message comes in for MQTT_QUIET_TIME or
+ * MQTT_COLLECT_TIMEOUT is reached. Returns the count of the messages.
+ */
+int MqttValues::getValues()
+{
+   unsigned long startMillis = millis();
+
+   mqttClient_.setServer(MQTT_SERVER, MQTT_PORT);
+   mqttClient_.setBufferSize(MQTT_BUFFER_SIZE);
+   mqttClient_.setCallback([this](char *topic, byte *payload, unsigned int length) {
+      onMessage(topic, payload, length);
+   });
+
+   if (!mqttClient_.connect(MQTT_NAME, MQTT_USER, MQTT_PASSWORD)) {
+      LOG_ERROR("MqttValues: connect -> connection failed!");
+      return 0;
+   }
+   LOG_DEBUG("MqttValues: connect -> connected!");
+   mqttClient_.subscribe("bmv/#");
+   mqttClient_.subscribe("mppt/#");
+   mqttClient_.subscribe(TASMOTA_SENSOR_TOPIC);
+   mqttClient_.subscribe(TASMOTA_LWT_TOPIC);
+
+   lastMillis_ = millis();
+   while (bulk_.getMissingCount() > 0 &&
+          millis() - startMillis < MQTT_COLLECT_TIMEOUT &&
+          millis() - lastMillis_ < MQTT_QUIET_TIME) {
+      // loop() reads one packet, the buffered ones are read without a sleep
+      if (!wifiClient_.available() && !waitReadable(startMillis)) {
+         continue;
+      }
+      if (!mqttClient_.loop()) {
+         break;
+      }
+   }
+   mqttClient_.disconnect();
+   LOG_INFO("MqttValues: %d messages, %d values missing, %lu ms", messages_, bulk_.getMissingCount(), millis() - startMillis);
+   return messages_;
+}
+
+#endif // DATA_SOURCE_MQTT
+
+/* ***************************************************************************** */
+/* *** class IoBrokerFetcher *************************************************** */
+/* ***************************************************************************** */
+
+/** Type of a bound MyData field */
+enum BINDING_TYPE { BIND_DOUBLE, BIND_STRING, BIND_TIMESTAMP, BIND_HISTORY, BIND_ENERGY };
+
+/** Fetch priority of a binding, the higher priorities are requested first */
+enum BINDING_PRIO { PRIO_NORMAL, PRIO_HIGH };
+
+/**
+  * Binding of one IoBroker state to a field of MyData.
+  * The histories are read with a query, all the other states with the bulk request
+  * (or from the retained mqtt messages). An energy binding integrates the points of
+  * the history with the same id (bound before), or of its own raw request.
+  */
+struct IoBrokerBinding
+{
+   const char                   *id;         //!< IoBroker state id
+   BINDING_TYPE                  type;       //!< Type of the field
+   size_t                        field;      //!< Offset of the field in MyData (BIND_FIELD)
+   size_t                        lastChange; //!< Offset of the DateTime of the last change (BIND_NONE = unused)
+   float                         scale;      //!< Multiplication factor of the values
+   BINDING_PRIO                  prio;       //!< Fetch priority
+   int                           days;       //!< History: count of the shown days
+   IoBrokerHistory::HISTORY_TYPE aggregate;  //!< History: aggregation of one bucket
+};
+
+/** All the IoBroker states of MyData. */
+const IoBrokerBinding IOBROKER_BINDINGS[] = {
+   //  id                                        type            field                                       last change                          scale prio         days aggregate
+   { "mqtt.0.bmv.CE",                          BIND_DOUBLE,    BIND_FIELD(bmv.consumedAmpHours),           BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.bmv.SOC",                         BIND_DOUBLE,    BIND_FIELD(bmv.stateOfCharge),              BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.bmv.DM",                          BIND_DOUBLE,    BIND_FIELD(bmv.midPointDeviation),          BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.bmv.H4",                          BIND_DOUBLE,    BIND_FIELD(bmv.numberOfChargeCycles),       BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.bmv.H17",                         BIND_DOUBLE,    BIND_FIELD(bmv.dischargedEnergy),           BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.bmv.H18",                         BIND_DOUBLE,    BIND_FIELD(bmv.chargedEnergy),              BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.bmv.H6",                          BIND_DOUBLE,    BIND_FIELD(bmv.cumulativeAmpHoursDrawn),    BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.bmv.H9",                          BIND_DOUBLE,    BIND_FIELD(bmv.secondsSinceLastFullCharge), BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.bmv.I",                           BIND_DOUBLE,    BIND_FIELD(bmv.batteryCurrent),             BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.bmv.P",                           BIND_DOUBLE,    BIND_FIELD(bmv.instantaneousPower),         BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.bmv.Relay",                       BIND_STRING,    BIND_FIELD(bmv.relay),                      BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.bmv.TTG",                         BIND_DOUBLE,    BIND_FIELD(bmv.timeToGo),                   BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.bmv.AR",                          BIND_DOUBLE,    BIND_FIELD(bmv.alarmReason),                BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.bmv.V",                           BIND_DOUBLE,    BIND_FIELD(bmv.mainVoltage),                BIND_FIELD(bmv.lastChange),          1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   // Prefer the acquisition time of the bridge, the ioBroker 'ts' is the arrival time.
+   { "mqtt.0.bmv.Timestamp",                   BIND_TIMESTAMP, BIND_FIELD(bmv.lastChange),                 BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+
+   { "mqtt.0.mppt.CS",                         BIND_DOUBLE,    BIND_FIELD(mppt.stateOfOperation),          BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.mppt.H19",                        BIND_DOUBLE,    BIND_FIELD(mppt.yieldTotal),                BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.mppt.H20",                        BIND_DOUBLE,    BIND_FIELD(mppt.yieldToday),                BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.mppt.H21",                        BIND_DOUBLE,    BIND_FIELD(mppt.maximumPowerToday),         BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.mppt.H22",                        BIND_DOUBLE,    BIND_FIELD(mppt.yieldYesterday),            BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.mppt.H23",                        BIND_DOUBLE,    BIND_FIELD(mppt.maximumPowerYesterday),     BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.mppt.I",                          BIND_DOUBLE,    BIND_FIELD(mppt.batteryCurrent),            BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.mppt.PPV",                        BIND_DOUBLE,    BIND_FIELD(mppt.panelPower),                BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.mppt.V",                          BIND_DOUBLE,    BIND_FIELD(mppt.mainVoltage),               BIND_FIELD(mppt.lastChange),         1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.mppt.VPV",                        BIND_DOUBLE,    BIND_FIELD(mppt.panelVoltage),              BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.mppt.ERR",                        BIND_DOUBLE,    BIND_FIELD(mppt.errorCode),                 BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "mqtt.0.mppt.Timestamp",                  BIND_TIMESTAMP, BIND_FIELD(mppt.lastChange),                BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+
+   { "sonoff.0.TasmotaElite.ENERGY_Voltage",   BIND_DOUBLE,    BIND_FIELD(tasmotaElite.voltage),           BIND_FIELD(tasmotaElite.lastChange), 1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "sonoff.0.TasmotaElite.ENERGY_Current",   BIND_DOUBLE,    BIND_FIELD(tasmotaElite.ampere),            BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "sonoff.0.TasmotaElite.ENERGY_Power",     BIND_DOUBLE,    BIND_FIELD(tasmotaElite.power),             BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+   { "sonoff.0.TasmotaElite.alive",            BIND_STRING,    BIND_FIELD(tasmotaElite.alive),             BIND_NONE,                           1.0,  PRIO_HIGH,   0,  IoBrokerHistory::AVG },
+
+   { "mqtt.0.bmv.SOC",                         BIND_HISTORY,   BIND_FIELD(bmv.chargeHistory),              BIND_NONE,                           1.0,  PRIO_NORMAL, 21, IoBrokerHistory::AVG },
+   { "mqtt.0.mppt.PPV",                        BIND_HISTORY,   BIND_FIELD(mppt.ppvHistory),                BIND_NONE,                           1.0,  PRIO_NORMAL, 21, IoBrokerHistory::MINMAX },
+   { "sonoff.0.TasmotaElite.ENERGY_Power",     BIND_HISTORY,   BIND_FIELD(tasmotaElite.powerHistory),      BIND_NONE,                           1.0,  PRIO_NORMAL, 7,  IoBrokerHistory::MAX },
+
+   { "mqtt.0.mppt.PPV",                        BIND_ENERGY,    BIND_FIELD(energy.solar),                   BIND_NONE,                           1.0,  PRIO_NORMAL, 0,  IoBrokerHistory::AVG },
+   { "mqtt.0.bmv.P",                           BIND_ENERGY,    BIND_FIELD(energy.battery),                 BIND_NONE,                           1.0,  PRIO_NORMAL, 0,  IoBrokerHistory::AVG },
+   { "sonoff.0.TasmotaElite.ENERGY_Power",     BIND_ENERGY,    BIND_FIELD(energy.grid),                    BIND_NONE,                           1.0,  PRIO_NORMAL, 0,  IoBrokerHistory::AVG },
+};
+
+/**
+  * Reads all the bound MyData fields.
+  * The current values are collected with one bulk request (or from the mqtt broker),
+  * the histories are queued by their priority and fetched over the connection pool.
+  * Every history is kept in a HistoryArchive of several resolutions.
+  * The last changes of the history states are read together with the current values,
+  * the history of an unchanged state is not requested again.
+  * The energy is integrated from the raw points of the power histories, the daily
+  * yields of the graphs are filled from it.
+  * All requests share one time budget, the requests which are not finished in
+  * time are skipped. Their fields keep the old values and are marked as stale.
+  */
+class IoBrokerFetcher
+{
+protected:
+   MyData                &myData_;                               //!< The filled data
+   IoBrokerWifiClient     wifiClient_;                           //!< Main connection
+   IoBrokerBulk           bulk_;                                 //!< Bulk request of the current values
+   HistoryArchive        *archives_[FETCH_MAX_HISTORIES];        //!< History archives
+   IoBrokerValue         *historyStates_[FETCH_MAX_HISTORIES];   //!< Last change requests of the history states
+   const IoBrokerBinding *historyBindings_[FETCH_MAX_HISTORIES]; //!< Bindings of the history requests
+   int                    historyCount_;                         //!< Count of the history requests
+   IoBrokerEnergy        *energies_[FETCH_MAX_HISTORIES];        //!< Power requests of the energy without a history
+   int                    energyCount_;                          //!< Count of the energy requests
+
+protected:
+   int  findHistory   (const char *id);
+   void bind          (const IoBrokerBinding &binding);
+   void queueValues   ();
+   void queueStates   ();
+   void queueHistories();
+   void finish        ();
+
+public:
+   IoBrokerFetcher(MyData &myData, const IoBrokerBinding *bindings, int count);
+   ~IoBrokerFetcher();
+
+   bool fetch();
+};
+
+IoBrokerFetcher::IoBrokerFetcher(MyData &myData, const IoBrokerBinding *bindings, int count)
+   : myData_(myData)
+   , bulk_(wifiClient_)
+   , historyCount_(0)
+   , energyCount_(0)
+{
+   for (int i = 0; i < count; i++) {
+      bind(bindings[i]);
+   }
+}
+
+IoBrokerFetcher::~IoBrokerFetcher()
+{
+   for (int i = 0; i < historyCount_; i++) {
+      delete archives_[i];
+      delete historyStates_[i];
+   }
+   for (int i = 0; i < energyCount_; i++) {
+      delete energies_[i];
+   }
+}
+
+/* Index of the history of the state id (-1 = none). */
+int IoBrokerFetcher::findHistory(const char *id)
+{
+   for (int i = 0; i < historyCount_; i++) {
+      if (strcmp(historyBindings_[i]->id, id) == 0) {
+         return i;
+      }
+   }
+   return -1;
+}
+
+/* Register the field of one binding at the bulk request or create its history request. */
+void IoBrokerFetcher::bind(const IoBrokerBinding &binding)
+{
+   uint8_t  *base       = (uint8_t *) &myData_;
+   DateTime *lastChange = binding.lastChange != BIND_NONE ? (DateTime *) (base + binding.lastChange) : NULL;
+
+   switch (binding.type) {
+      case BIND_DOUBLE:
+         bulk_.add(*(double *) (base + binding.field), binding.id, lastChange, binding.scale);
+         break;
+      case BIND_STRING:
+         bulk_.add(*(String *) (base + binding.field), binding.id, lastChange);
+         break;
+      case BIND_TIMESTAMP:
+         bulk_.addTimestamp(*(DateTime *) (base + binding.field), binding.id);
+         break;
+      case BIND_HISTORY:
+         if (historyCount_ < FETCH_MAX_HISTORIES) {
+            archives_[historyCount_]        = new HistoryArchive(wifiClient_, *(HistoryData *) (base + binding.field),
+                                                                 binding.id, binding.scale, binding.days, binding.aggregate);
+            historyStates_[historyCount_]   = new IoBrokerValue(wifiClient_);
+            historyBindings_[historyCount_] = &binding;
+            historyCount_++;
+         } else {
+            LOG_ERROR("IoBrokerFetcher: too many histories, %s ignored!", binding.id);
+         }
+         break;
+      case BIND_ENERGY: {
+         EnergyCounter *counter = (EnergyCounter *) (base + binding.field);
+         int            history = findHistory(binding.id);
+
+         if (history >= 0) {
+            archives_[history]->setEnergy(counter);
+         } else if (energyCount_ < FETCH_MAX_HISTORIES) {
+            energies_[energyCount_++] = new IoBrokerEnergy(wifiClient_, *counter, binding.id, binding.scale);
+         } else {
+            LOG_ERROR("IoBrokerFetcher: too many energies, %s ignored!", binding.id);
+         }
+         break;
+      }
+   }
+}
+
+/* Queue the bulk request of the current values. */
+void IoBrokerFetcher::queueValues()
+{
+#if DATA_SOURCE == DATA_SOURCE_MQTT
+   // The current values are the retained messages of the bridge, only the histories come from the IoBroker.
+   MqttValues mqttValues(bulk_);
+
+   mqttValues.getValues();
+#else
+   bulk_.queueBulkValues();
+#endif
+}
+
+/* Prepare the stored histories and queue the requests of their states, the higher priorities first. */
+void IoBrokerFetcher::queueStates()
+{
+   for (int prio = PRIO_HIGH; prio >= PRIO_NORMAL; prio--) {
+      for (int i = 0; i < historyCount_; i++) {
+         if (historyBindings_[i]->prio == prio) {
+            archives_[i]->prepare();
+            historyStates_[i]->queueState(historyBindings_[i]->id);
+         }
+      }
+   }
+   for (int i = 0; i < energyCount_; i++) {
+      energies_[i]->prepare();
+   }
+}
+
+/* Queue the requests of the changed histories, the higher priorities first, and of the energies. */
+void IoBrokerFetcher::queueHistories()
+{
+   int skipped = 0;
+
+   for (int prio = PRIO_HIGH; prio >= PRIO_NORMAL; prio--) {
+      for (int i = 0; i < historyCount_; i++) {
+         if (historyBindings_[i]->prio == prio) {
+            if (archives_[i]->queueRequests(*historyStates_[i]) == 0) {
+               skipped++;
+            }
+         }
+      }
+   }
+   for (int i = 0; i < energyCount_; i++) {
+      energies_[i]->queueRequest();
+   }
+   LOG_INFO("IoBrokerFetcher: %d of %d histories unchanged", skipped, historyCount_);
+}
+
+/* Check the results and read the missing ones with single requests, the current values first. */
+void IoBrokerFetcher::finish()
+{
+   bulk_.finishBulkValues();
+   myData_.missingValues = bulk_.getMissingCount();
+   for (int prio = PRIO_HIGH; prio >= PRIO_NORMAL; prio--) {
+      for (int i = 0; i < historyCount_; i++) {
+         if (historyBindings_[i]->prio == prio) {
+            archives_[i]->finish();
+         }
+      }
+   }
+   for (int i = 0; i < energyCount_; i++) {
+      energies_[i]->finish();
+   }
+   myData_.UpdateYields();
+}
+
+/* Read all the bound fields. Returns false if none of the current values was received. */
+bool IoBrokerFetcher::fetch()
+{
+   unsigned long startMillis = millis();
+   uint32_t      freeHeap    = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+   queueValues();
+   queueStates();
+   {
+      IoBrokerPool pool(wifiClient_);
+
+      pool.run(); // the current values and the history states
+      queueHistories();
+      pool.run(); // the changed histories
+   } // The pool adds the statistic of its connections on destruction.
+   finish();
+   IoBrokerWifiClient::startBudget(0);
+
+   wifiClient_.dumpStatistic(millis() - startMillis, freeHeap);
+   if (myData_.IsStale()) {
+      LOG_INFO("IoBrokerFetcher: %d values missing, some data are stale!", myData_.missingValues);
+   }
+   return bulk_.getMissingCount() < bulk_.getCount();
 }
 
 /* ***************************************************************************** */
 /* *** GetIoBrokerValues() ***************************************************** */
 /* ***************************************************************************** */
 
-/* Helper Funktion to read all the IoBroker data into the data object. */
-void GetIoBrokerValues(MyData &myData)
-{
-   IoBrokerWifiClient  ioBrokerWifiClient;
-   IoBrokerPlain       ioBrokerPlain            (ioBrokerWifiClient);
-   IoBrokerValue       ioBrokerValue            (ioBrokerWifiClient);
-   IoBrokerHistory     ioBrokerChargeHistory    (ioBrokerWifiClient, myData.bmv.chargeHistory,         1.0,  21, IoBrokerHistory::AVG); // 21 days
-   IoBrokerHistory     ioBrokerPPVHistory       (ioBrokerWifiClient, myData.mppt.ppvHistory,           1.0,  21, IoBrokerHistory::AVG); // 21 days
-   IoBrokerHistory     ioBrokerPPVYieldHistory  (ioBrokerWifiClient, myData.mppt.yieldHistory,         0.01, 21, IoBrokerHistory::MAX); // 21 days
-   IoBrokerHistory     ioBrokerGridHistory      (ioBrokerWifiClient, myData.tasmotaElite.powerHistory, 1.0,   7, IoBrokerHistory::MAX); //  7 days
-   IoBrokerHistory     ioBrokerGridYieldHistory (ioBrokerWifiClient, myData.tasmotaElite.yieldHistory, 1.0,   7, IoBrokerHistory::MAX); //  7 days
-
-   ioBrokerPlain.getPlainValue(myData.bmv.consumedAmpHours,           "mqtt.0.bmv.CE");
-   ioBrokerPlain.getPlainValue(myData.bmv.stateOfCharge,              "mqtt.0.bmv.SOC");
-   ioBrokerPlain.getPlainValue(myData.bmv.midPointDeviation,          "mqtt.0.bmv.DM");
-   ioBrokerPlain.getPlainValue(myData.bmv.numberOfChargeCycles,       "mqtt.0.bmv.H4");
-   ioBrokerPlain.getPlainValue(myData.bmv.dischargedEnergy,           "mqtt.0.bmv.H17");
-   ioBrokerPlain.getPlainValue(myData.bmv.chargedEnergy,              "mqtt.0.bmv.H18");
-   ioBrokerPlain.getPlainValue(myData.bmv.cumulativeAmpHoursDrawn,    "mqtt.0.bmv.H6");
-   ioBrokerPlain.getPlainValue(myData.bmv.secondsSinceLastFullCharge, "mqtt.0.bmv.H9");
-   ioBrokerPlain.getPlainValue(myData.bmv.batteryCurrent,             "mqtt.0.bmv.I");
-   ioBrokerPlain.getPlainValue(myData.bmv.instantaneousPower,         "mqtt.0.bmv.P");
-   ioBrokerPlain.getPlainValue(myData.bmv.relay,                      "mqtt.0.bmv.Relay");
-   ioBrokerPlain.getPlainValue(myData.bmv.timeToGo,                   "mqtt.0.bmv.TTG");
-   ioBrokerPlain.getPlainValue(myData.bmv.mainVoltage,                "mqtt.0.bmv.V");
-   ioBrokerValue.getLastChange(myData.bmv.lastChange,                 "mqtt.0.bmv.V");
-
-   ioBrokerChargeHistory.getHistoryValues("mqtt.0.bmv.SOC");
-
-   ioBrokerPlain.getPlainValue(myData.mppt.stateOfOperation,          "mqtt.0.mppt.CS");
-   ioBrokerPlain.getPlainValue(myData.mppt.yieldTotal,                "mqtt.0.mppt.H19");
-   ioBrokerPlain.getPlainValue(myData.mppt.yieldToday,                "mqtt.0.mppt.H20");
-   ioBrokerPlain.getPlainValue(myData.mppt.maximumPowerToday,         "mqtt.0.mppt.H21");
-   ioBrokerPlain.getPlainValue(myData.mppt.yieldYesterday,            "mqtt.0.mppt.H22");
-   ioBrokerPlain.getPlainValue(myData.mppt.maximumPowerYesterday,     "mqtt.0.mppt.H23");
-   ioBrokerPlain.getPlainValue(myData.mppt.batteryCurrent,            "mqtt.0.mppt.I");
-   ioBrokerPlain.getPlainValue(myData.mppt.panelPower,                "mqtt.0.mppt.PPV");
-   ioBrokerPlain.getPlainValue(myData.mppt.mainVoltage,               "mqtt.0.mppt.V");
-   ioBrokerPlain.getPlainValue(myData.mppt.panelVoltage,              "mqtt.0.mppt.VPV");
-   ioBrokerValue.getLastChange(myData.mppt.lastChange,                "mqtt.0.mppt.V");
-
-   ioBrokerPPVHistory.getHistoryValues      ("mqtt.0.mppt.PPV");
-   ioBrokerPPVYieldHistory.getHistoryValues ("mqtt.0.mppt.H22");
-
-   ioBrokerPlain.getPlainValue(myData.tasmotaElite.voltage,           "sonoff.0.TasmotaElite.ENERGY_Voltage");
-   ioBrokerPlain.getPlainValue(myData.tasmotaElite.ampere,            "sonoff.0.TasmotaElite.ENERGY_Current");
-   ioBrokerPlain.getPlainValue(myData.tasmotaElite.power,             "sonoff.0.TasmotaElite.ENERGY_Power");
-   ioBrokerPlain.getPlainValue(myData.tasmotaElite.alive,             "sonoff.0.TasmotaElite.alive");
-   ioBrokerValue.getLastChange(myData.tasmotaElite.lastChange,        "sonoff.0.TasmotaElite.ENERGY_Voltage");
-
-   ioBrokerGridHistory.getHistoryValues      ("sonoff.0.TasmotaElite.ENERGY_Power");
-   ioBrokerGridYieldHistory.getHistoryValues ("sonoff.0.TasmotaElite.ENERGY_Yesterday");
+/* Helper Funktion to read all the IoBroker data into the data object. Returns false if nothing was received. */
+bool GetIoBrokerValues(MyData &myData)
+{
+   IoBrokerWifiClient::startBudget(FETCH_TIME_BUDGET); // the connect of the fetcher counts too
+
+   IoBrokerFetcher fetcher(myData, IOBROKER_BINDINGS, BINDING_COUNT(IOBROKER_BINDINGS));
+
+   return fetcher.fetch();
 }
@@ -30,7 +30,7 @@ void updateRTC()
   struct tm  timeinfo;
   
   if (!getLocalTime(&timeinfo)) {
-    Serial.println("Failed to obtain time");
+    LOG_ERROR("Failed to obtain time");
     return;
   }
 
@@ -0,0 +1,216 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Snapshot.h
+  *
+  * Snapshot of all the bound MyData fields in the flash file system.
+  * It is restored on every wake before the fetch, so the values which can not
+  * be fetched keep their last state and the display can show the last data
+  * without a wifi connection.
+  * The layout is defined by the IoBroker binding table: a float for a double,
+  * the length and the chars of a string, the unix time of a DateTime, the
+  * stored history of a HistoryData and the hours and days of an EnergyCounter.
+  * A changed table invalidates the file.
+  */
+#pragma once
+#include "Storage.h"
+
+#define SNAPSHOT_FILE      "/mydata.bin"
+#define SNAPSHOT_TEMP_FILE "/mydata.tmp"
+#define SNAPSHOT_MAGIC     0x4144594d // 'MYDA'
+#define SNAPSHOT_VERSION   3
+
+/** Header of the snapshot file */
+struct SnapshotHeader
+{
+   uint32_t magic;   //!< SNAPSHOT_MAGIC
+   uint16_t version; //!< SNAPSHOT_VERSION
+   uint16_t count;   //!< Count of the bindings
+   uint32_t layout;  //!< Hash of the binding table
+   uint32_t time;    //!< Time of the snapshot
+};
+
+/* Hash of the ids and types of the bindings. */
+uint32_t GetSnapshotLayout(const IoBrokerBinding *bindings, int count)
+{
+   uint32_t hash = 2166136261UL; // FNV-1a
+
+   for (int i = 0; i < count; i++) {
+      for (const char *c = bindings[i].id; *c; c++) {
+         hash = (hash ^ (uint8_t) *c) * 16777619UL;
+      }
+      hash = (hash ^ (uint8_t) bindings[i].type) * 16777619UL;
+      hash = (hash ^ (uint8_t) (bindings[i].lastChange != BIND_NONE)) * 16777619UL;
+   }
+   return hash;
+}
+
+/* Write one bound field (and its last change) of the binding. */
+bool WriteSnapshotField(File &file, uint8_t *base, const IoBrokerBinding &binding)
+{
+   bool ret = false;
+
+   switch (binding.type) {
+      case BIND_DOUBLE: {
+         float value = *(double *) (base + binding.field);
+
+         ret = file.write((uint8_t *) &value, sizeof(value)) == sizeof(value);
+         break;
+      }
+      case BIND_STRING: {
+         String  &value  = *(String *) (base + binding.field);
+         uint8_t  length = value.length() < 255 ? value.length() : 255;
+
+         ret = file.write(&length, sizeof(length)) == sizeof(length) &&
+               file.write((uint8_t *) value.c_str(), length) == length;
+         break;
+      }
+      case BIND_TIMESTAMP: {
+         uint32_t time = ((DateTime *) (base + binding.field))->unixtime();
+
+         ret = file.write((uint8_t *) &time, sizeof(time)) == sizeof(time);
+         break;
+      }
+      case BIND_HISTORY:
+         ret = ((HistoryData *) (base + binding.field))->save(file);
+         break;
+      case BIND_ENERGY:
+         ret = ((EnergyCounter *) (base + binding.field))->save(file);
+         break;
+   }
+   if (ret && binding.lastChange != BIND_NONE) {
+      uint32_t time = ((DateTime *) (base + binding.lastChange))->unixtime();
+
+      ret = file.write((uint8_t *) &time, sizeof(time)) == sizeof(time);
+   }
+   return ret;
+}
+
+/* Read one bound field (and its last change) of the binding. */
+bool ReadSnapshotField(File &file, uint8_t *base, const IoBrokerBinding &binding)
+{
+   bool ret = false;
+
+   switch (binding.type) {
+      case BIND_DOUBLE: {
+         float value = 0.0;
+
+         ret = file.read((uint8_t *) &value, sizeof(value)) == sizeof(value);
+         if (ret) {
+            *(double *) (base + binding.field) = value;
+         }
+         break;
+      }
+      case BIND_STRING: {
+         char    buffer[256];
+         uint8_t length = 0;
+
+         ret = file.read(&length, sizeof(length)) == sizeof(length) &&
+               file.read((uint8_t *) buffer, length) == length;
+         if (ret) {
+            buffer[length] = '\0';
+            *(String *) (base + binding.field) = buffer;
+         }
+         break;
+      }
+      case BIND_TIMESTAMP: {
+         uint32_t time = 0;
+
+         ret = file.read((uint8_t *) &time, sizeof(time)) == sizeof(time);
+         if (ret) {
+            *(DateTime *) (base + binding.field) = DateTime(time);
+         }
+         break;
+      }
+      case BIND_HISTORY:
+         ret = ((HistoryData *) (base + binding.field))->load(file);
+         break;
+      case BIND_ENERGY:
+         ret = ((EnergyCounter *) (base + binding.field))->load(file);
+         break;
+   }
+   if (ret && binding.lastChange != BIND_NONE) {
+      uint32_t time = 0;
+
+      ret = file.read((uint8_t *) &time, sizeof(time)) == sizeof(time);
+      if (ret) {
+         *(DateTime *) (base + binding.lastChange) = DateTime(time);
+      }
+   }
+   return ret;
+}
+
+/*
+ * Store all the bound fields after a fetch. The file is written to a temporary
+ * one and renamed, so a reset while writing keeps the last snapshot.
+ */
+bool SaveSnapshot(MyData &myData)
+{
+   SnapshotHeader header = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION, (uint16_t) BINDING_COUNT(IOBROKER_BINDINGS),
+                             GetSnapshotLayout(IOBROKER_BINDINGS, BINDING_COUNT(IOBROKER_BINDINGS)), (uint32_t) GetRTCTime() };
+   bool           ret    = false;
+
+   if (StartStorage()) {
+      File file = SPIFFS.open(SNAPSHOT_TEMP_FILE, FILE_WRITE);
+
+      if (file) {
+         ret = file.write((uint8_t *) &header, sizeof(header)) == sizeof(header);
+         for (int i = 0; ret && i < header.count; i++) {
+            ret = WriteSnapshotField(file, (uint8_t *) &myData, IOBROKER_BINDINGS[i]);
+         }
+         file.close();
+         if (ret) {
+            SPIFFS.remove(SNAPSHOT_FILE);
+            ret = SPIFFS.rename(SNAPSHOT_TEMP_FILE, SNAPSHOT_FILE);
+         }
+      }
+   }
+   if (!ret) {
+      LOG_ERROR("SaveSnapshot *** FAILED ***");
+   }
+   return ret;
+}
+
+/* Restore all the bound fields. Returns the time of the snapshot (0 = no valid snapshot). */
+time_t LoadSnapshot(MyData &myData)
+{
+   SnapshotHeader header;
+   bool           ret = false;
+
+   if (StartStorage()) {
+      File file = SPIFFS.open(SNAPSHOT_FILE, FILE_READ);
+
+      if (file) {
+         ret = file.read((uint8_t *) &header, sizeof(header)) == sizeof(header) &&
+               header.magic   == SNAPSHOT_MAGIC   &&
+               header.version == SNAPSHOT_VERSION &&
+               header.count   == BINDING_COUNT(IOBROKER_BINDINGS) &&
+               header.layout  == GetSnapshotLayout(IOBROKER_BINDINGS, BINDING_COUNT(IOBROKER_BINDINGS));
+         for (int i = 0; ret && i < header.count; i++) {
+            ret = ReadSnapshotField(file, (uint8_t *) &myData, IOBROKER_BINDINGS[i]);
+         }
+         file.close();
+      }
+   }
+   if (!ret) {
+      LOG_INFO("LoadSnapshot: no valid snapshot");
+      return 0;
+   }
+   myData.UpdateYields();
+   LOG_INFO("LoadSnapshot: data of %s", getDateTimeString(header.time).c_str());
+   return header.time;
+}
@@ -0,0 +1,38 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Storage.h
+  * 
+  * Flash file system for the data which must survive the shutdown between two wakes.
+  */
+#pragma once
+#include <FS.h>
+#include <SPIFFS.h>
+
+/* Mount the flash file system once, format it on the first start. */
+bool StartStorage()
+{
+   static bool mounted = false;
+
+   if (!mounted) {
+      mounted = SPIFFS.begin(true);
+      if (!mounted) {
+         LOG_ERROR("Mount SPIFFS *** FAILED ***");
+      }
+   }
+   return mounted;
+}
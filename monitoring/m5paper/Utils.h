@@ -23,6 +23,7 @@
 #include <stdarg.h>
 #include <Time.h>
 #include <TimeLib.h> 
+#include "Storage.h"
 
 /**
   * Profiling helper class.
@@ -45,43 +46,89 @@ public:
       int iMillis = millis();
 
       // if ((float) (iMillis - m_iMillis) / 1000.0 >= 0.02) {
-         Serial.printf("\n***% 2.2f sec [% 2.2f sec] %s\n", (float) (iMillis - m_iMillis) / 1000.0, (float) (iMillis / 1000.0), m_Info.c_str());
+         LOG_DEBUG("***% 2.2f sec [% 2.2f sec] %s", (float) (iMillis - m_iMillis) / 1000.0, (float) (iMillis / 1000.0), m_Info.c_str());
       // }
    }
 };
 
 #define TIME_PROF(m) CTimeProf TimeProf(m);
 
+#define HISTORY_FILE_MAGIC   0x54534948 // 'HIST'
+#define HISTORY_FILE_VERSION 4
+
 /**
-  * HistoryData: A collection af history float values with its DateTime position.
+  * HistoryData: A collection af history values on an implicit timeline.
+  * The buckets are aligned to multiples of step_ seconds, so a stored history
+  * can be shifted to the next time window and only the new buckets must be read.
+  * The values are stored as 16 bit multiples of the series scale_ (resolution),
+  * use the accessors to read and write them.
+  * A band history keeps the lowest value of every bucket in lows_ too,
+  * values_ is the highest one then (min/max envelope).
   */
 class HistoryData
 {
 public:
-   int       size_;     //!< Size of the history items.
-   float    *values_;   //!< Histpry double values.
-   DateTime *dates_;    //!< History timeline.
-   String    unitName_; //!< Unit Name of the values
-   int      *counts_;   //!< Occurence.
-   float     max_;      //!< Max value.
+   int       size_;        //!< Size of the history items.
+   uint16_t *values_;      //!< Quantized history values.
+   uint16_t *lows_;        //!< Quantized lower envelope of a band history (NULL = no band).
+   float     scale_;       //!< Value of one quantization step.
+   String    unitName_;    //!< Unit Name of the values
+   float     max_;         //!< Max value.
+   time_t    start_;       //!< Start of the first bucket.
+   int       step_;        //!< Seconds of one bucket.
+   time_t    lastFetched_; //!< Newest timestamp of the received data (0 = nothing received).
+   time_t    lastChange_;  //!< Last change of the state when the history was read (0 = unknown).
+   bool      stale_;       //!< Not updated by the last fetch, the values are the cached ones.
+
+protected:
+   /** Header of the stored history file */
+   struct FileHeader
+   {
+      uint32_t magic;       //!< HISTORY_FILE_MAGIC
+      uint16_t version;     //!< HISTORY_FILE_VERSION
+      uint16_t size;        //!< size_
+      int32_t  step;        //!< step_
+      uint32_t start;       //!< start_
+      uint32_t lastFetched; //!< lastFetched_
+      uint32_t lastChange;  //!< lastChange_
+      float    scale;       //!< scale_
+   };
+
+   /* Round the value to the next quantization step, clipped to 0 ... 65535 steps. */
+   uint16_t quantize(float value)
+   {
+      float steps = value / scale_ + 0.5;
+
+      if (steps <= 0.0) {
+         return 0;
+      }
+      return steps >= UINT16_MAX ? UINT16_MAX : (uint16_t) steps;
+   }
 
 public:
-   HistoryData(int historySize, String unitName)
+   HistoryData(int historySize, String unitName, float scale, bool band = false)
       : size_(historySize)
+      , lows_(NULL)
+      , scale_(scale)
       , unitName_(unitName)
       , max_(0.0)
+      , start_(0)
+      , step_(0)
+      , lastFetched_(0)
+      , lastChange_(0)
+      , stale_(false)
    {
-      values_ = new float[size_];
-      dates_  = new DateTime[size_];
-      counts_ = new int[size_];
+      values_ = new uint16_t[size_];
+      if (band) {
+         lows_ = new uint16_t[size_];
+      }
 
       clear();
    }
    ~HistoryData()
    {
       delete [] values_;
-      delete [] dates_;
-      delete [] counts_;
+      delete [] lows_;
    }
 
    float getMax()
@@ -89,12 +136,456 @@ public:
       return ceil(max_);
    }
 
+   /* Is this a min/max band history? */
+   bool isBand()
+   {
+      return lows_ != NULL;
+   }
+
+   /* Value of the bucket, the upper edge of a band. */
+   float getValue(int index)
+   {
+      return values_[index] * scale_;
+   }
+
+   /* Lower edge of the band, the value of a normal history. */
+   float getLow(int index)
+   {
+      return (lows_ ? lows_[index] : values_[index]) * scale_;
+   }
+
+   /* Start time of the bucket. */
+   DateTime getDate(int index)
+   {
+      return DateTime((uint32_t) (start_ + (time_t) index * step_));
+   }
+
+   /* Store the value of the bucket, rounded to the scale. */
+   void setValue(int index, float value)
+   {
+      values_[index] = quantize(value);
+   }
+
+   /* Store the lower edge of a band bucket. */
+   void setLow(int index, float value)
+   {
+      if (lows_) {
+         lows_[index] = quantize(value);
+      }
+   }
+
    void clear()
    {
-      memset(values_, 0, size_ * sizeof(float));
-      memset(dates_,  0, size_ * sizeof(DateTime));
-      memset(counts_, 0, size_ * sizeof(int));
-      max_ = 0.0;
+      memset(values_, 0, size_ * sizeof(uint16_t));
+      if (lows_) {
+         memset(lows_, 0, size_ * sizeof(uint16_t));
+      }
+      max_         = 0.0;
+      lastFetched_ = 0;
+      lastChange_  = 0;
+   }
+
+   /* Set the timeline of the buckets. */
+   void setTimeline(time_t start, int step)
+   {
+      start_ = start;
+      step_  = step;
+   }
+
+   /* Move the values 'buckets' positions to the past, the new buckets are empty. */
+   void shift(int buckets)
+   {
+      if (buckets >= size_) {
+         clear();
+      } else if (buckets > 0) {
+         memmove(values_, values_ + buckets, (size_ - buckets) * sizeof(uint16_t));
+         memset(values_ + size_ - buckets, 0, buckets * sizeof(uint16_t));
+         if (lows_) {
+            memmove(lows_, lows_ + buckets, (size_ - buckets) * sizeof(uint16_t));
+            memset(lows_ + size_ - buckets, 0, buckets * sizeof(uint16_t));
+         }
+      }
+   }
+
+   /* Empty all buckets from index to the end. */
+   void clearFrom(int index)
+   {
+      if (index >= 0 && index < size_) {
+         memset(values_ + index, 0, (size_ - index) * sizeof(uint16_t));
+         if (lows_) {
+            memset(lows_ + index, 0, (size_ - index) * sizeof(uint16_t));
+         }
+      }
+   }
+
+   /* Calculate the max value of all buckets. */
+   void updateMax()
+   {
+      uint16_t max = 0;
+
+      for (int i = 0; i < size_; i++) {
+         if (max < values_[i]) {
+            max = values_[i];
+         }
+      }
+      max_ = max * scale_;
+   }
+
+   /* Read the history at the position of the open file, start_ and step_ are replaced by the stored timeline. */
+   bool load(File &file)
+   {
+      FileHeader header;
+
+      if (file.read((uint8_t *) &header, sizeof(header)) == sizeof(header) &&
+          header.magic   == HISTORY_FILE_MAGIC   &&
+          header.version == HISTORY_FILE_VERSION &&
+          header.size    == size_                &&
+          header.scale   == scale_) {
+         if (file.read((uint8_t *) values_, size_ * sizeof(uint16_t)) == size_ * sizeof(uint16_t) &&
+             (!lows_ || file.read((uint8_t *) lows_, size_ * sizeof(uint16_t)) == size_ * sizeof(uint16_t))) {
+            start_       = header.start;
+            step_        = header.step;
+            lastFetched_ = header.lastFetched;
+            lastChange_  = header.lastChange;
+            return true;
+         }
+      }
+      return false;
+   }
+
+   /* Read the stored history with its timeline, it is cleared if the file is missing or does not fit. */
+   bool load(String fileName)
+   {
+      bool ret  = false;
+      File file = SPIFFS.open(fileName, FILE_READ);
+
+      if (file) {
+         ret = load(file);
+         file.close();
+      }
+      if (!ret) {
+         clear();
+      }
+      return ret;
+   }
+
+   /* Write the history at the position of the open file. */
+   bool save(File &file)
+   {
+      FileHeader header = { HISTORY_FILE_MAGIC, HISTORY_FILE_VERSION, (uint16_t) size_, step_, (uint32_t) start_, (uint32_t) lastFetched_, (uint32_t) lastChange_, scale_ };
+
+      return file.write((uint8_t *) &header, sizeof(header)) == sizeof(header) &&
+             file.write((uint8_t *) values_, size_ * sizeof(uint16_t)) == size_ * sizeof(uint16_t) &&
+             (!lows_ || file.write((uint8_t *) lows_, size_ * sizeof(uint16_t)) == size_ * sizeof(uint16_t));
+   }
+
+   /* Store the history for the next wake. */
+   bool save(String fileName)
+   {
+      bool ret  = false;
+      File file = SPIFFS.open(fileName, FILE_WRITE);
+
+      if (file) {
+         ret = save(file);
+         file.close();
+      }
+      return ret;
+   }
+};
+
+#define ENERGY_HOURS   48        // Hours of the hourly energy
+#define ENERGY_DAYS    21        // Days of the daily energy
+#define ENERGY_MAX_GAP (30 * 60) // Longer gaps between two points are not integrated (sec)
+
+time_t UtcToLocalTime(time_t utcTime); // the days of the EnergyCounter are local days
+
+/**
+  * EnergyCounter: Incremental trapezoid integration of a power series (W) into
+  * the energy of every hour and every day (kWh). The positive and the negative
+  * power are counted separately (battery charge and discharge), a trapezoid
+  * with a zero crossing is split there. A gap longer than ENERGY_MAX_GAP is not
+  * bridged. The last point is kept, so the points of the next wake continue it.
+  * The days are local days, their timeline is in local time. The energy of the
+  * current hour and day is summed up exactly, the 16 bit buckets only get the
+  * rounded sums. The days before the first complete counted day are seeded
+  * from a power history.
+  */
+class EnergyCounter
+{
+public:
+   HistoryData hoursIn_;   //!< Energy of the positive power per hour
+   HistoryData hoursOut_;  //!< Energy of the negative power per hour
+   HistoryData daysIn_;    //!< Energy of the positive power per local day
+   HistoryData daysOut_;   //!< Energy of the negative power per local day
+   time_t      firstTime_; //!< Time of the first integrated point (0 = none)
+   time_t      lastTime_;  //!< Time of the last integrated point (0 = none)
+   float       lastPower_; //!< Power of the last integrated point
+   int         gaps_;      //!< Gaps of the last update which are not bridged
+   time_t      hour_;      //!< Start of the current hour (0 = none)
+   time_t      day_;       //!< Start of the current day in local time (0 = none)
+   double      hourIn_;    //!< Positive energy of the current hour (Ws)
+   double      hourOut_;   //!< Negative energy of the current hour (Ws)
+   double      dayIn_;     //!< Positive energy of the current day (Ws)
+   double      dayOut_;    //!< Negative energy of the current day (Ws)
+
+protected:
+   /** Header of the stored counter */
+   struct FileHeader
+   {
+      uint32_t firstTime; //!< firstTime_
+      uint32_t lastTime;  //!< lastTime_
+      float    lastPower; //!< lastPower_
+      uint32_t hour;      //!< hour_
+      uint32_t day;       //!< day_
+      double   hourIn;    //!< hourIn_
+      double   hourOut;   //!< hourOut_
+      double   dayIn;     //!< dayIn_
+      double   dayOut;    //!< dayOut_
+   };
+
+   /* Shift the buckets to the window which ends with the bucket of the time. */
+   void align(HistoryData &history, time_t time, int step)
+   {
+      time_t start = (time / step + 1) * step - (time_t) step * history.size_;
+
+      if (history.step_ == step && start >= history.start_) {
+         history.shift((start - history.start_) / step);
+      } else {
+         history.clear();
+      }
+      history.setTimeline(start, step);
+   }
+
+   /* Store the energy (Ws) into the bucket of the time, a time outside of the history is ignored. */
+   void setEnergy(HistoryData &history, time_t time, double energy)
+   {
+      if (time >= history.start_) {
+         int index = (time - history.start_) / history.step_;
+
+         if (index < history.size_) {
+            history.setValue(index, energy / 3600000.0);
+         }
+      }
+   }
+
+   /* Write the sums of the current hour and day into their buckets. */
+   void flush()
+   {
+      if (hour_ > 0) {
+         setEnergy(hoursIn_,  hour_, hourIn_);
+         setEnergy(hoursOut_, hour_, hourOut_);
+      }
+      if (day_ > 0) {
+         setEnergy(daysIn_,  day_, dayIn_);
+         setEnergy(daysOut_, day_, dayOut_);
+      }
+   }
+
+   /* Add the energy (Ws) to the sums of the hour and the local day, a new hour or day starts with a finished bucket. */
+   void book(time_t hour, time_t day, double energy)
+   {
+      if (hour != hour_ || day != day_) {
+         flush();
+      }
+      if (hour != hour_) {
+         hour_    = hour;
+         hourIn_  = 0.0;
+         hourOut_ = 0.0;
+      }
+      if (day != day_) {
+         day_    = day;
+         dayIn_  = 0.0;
+         dayOut_ = 0.0;
+      }
+      if (energy > 0.0) {
+         hourIn_ += energy;
+         dayIn_  += energy;
+      } else {
+         hourOut_ -= energy;
+         dayOut_  -= energy;
+      }
+   }
+
+   /* Integrate the trapezoid inside one hour and one local day, it is split at the zero crossing. */
+   void addTrapezoid(time_t from, time_t day, float fromPower, time_t to, float toPower)
+   {
+      time_t hour    = from / (60 * 60) * (60 * 60);
+      float  seconds = to - from;
+
+      if ((fromPower < 0.0) != (toPower < 0.0)) {
+         float crossing = seconds * fromPower / (fromPower - toPower);
+
+         book(hour, day, fromPower * crossing / 2.0);
+         book(hour, day, toPower * (seconds - crossing) / 2.0);
+      } else {
+         book(hour, day, (fromPower + toPower) * seconds / 2.0);
+      }
+   }
+
+public:
+   EnergyCounter()
+      : hoursIn_ (ENERGY_HOURS, "kWh", 0.001)
+      , hoursOut_(ENERGY_HOURS, "kWh", 0.001)
+      , daysIn_  (ENERGY_DAYS,  "kWh", 0.001)
+      , daysOut_ (ENERGY_DAYS,  "kWh", 0.001)
+      , firstTime_(0)
+      , lastTime_(0)
+      , lastPower_(0.0)
+      , gaps_(0)
+      , hour_(0)
+      , day_(0)
+      , hourIn_(0.0)
+      , hourOut_(0.0)
+      , dayIn_(0.0)
+      , dayOut_(0.0)
+   {
+   }
+
+   /* Move the hours and the local days to the window which ends with the given time. */
+   void begin(time_t time)
+   {
+      align(hoursIn_,  time, 60 * 60);
+      align(hoursOut_, time, 60 * 60);
+      align(daysIn_,   UtcToLocalTime(time), 24 * 60 * 60);
+      align(daysOut_,  UtcToLocalTime(time), 24 * 60 * 60);
+      gaps_ = 0;
+   }
+
+   /* Integrate the power up to the next point. The points up to the last one are already counted. */
+   void add(time_t time, float power)
+   {
+      if (time <= lastTime_) {
+         return;
+      }
+      if (firstTime_ == 0) {
+         firstTime_ = time;
+      }
+      if (lastTime_ > 0 && time - lastTime_ > ENERGY_MAX_GAP) {
+         gaps_++;
+      } else if (lastTime_ > 0) {
+         time_t from      = lastTime_;
+         float  fromPower = lastPower_;
+
+         // Split the segment at the hour and the local day boundaries, the power there is interpolated.
+         while (from < time) {
+            time_t local   = UtcToLocalTime(from);
+            time_t day     = local / (24 * 60 * 60) * (24 * 60 * 60);
+            time_t to      = min(time, min((from / (60 * 60) + 1) * (60 * 60), from + day + 24 * 60 * 60 - local));
+            float  toPower = fromPower + (power - fromPower) * (to - from) / (time - from);
+
+            addTrapezoid(from, day, fromPower, to, toPower);
+            from      = to;
+            fromPower = toPower;
+         }
+      }
+      lastTime_  = time;
+      lastPower_ = power;
+   }
+
+   /* Write the energy of the current hour and day after the last point of an update. */
+   void finish()
+   {
+      flush();
+      if (gaps_ > 0) {
+         LOG_INFO("EnergyCounter: %d gaps without energy", gaps_);
+      }
+   }
+
+   /* 
+    * Fill the local days before the first complete counted day with an estimate of the
+    * positive energy of a power history: every bucket counts the midpoint of its low and
+    * its value times its width. That is the mean of an average history, but only the
+    * middle of the band of a min/max history. So the yields of the days before the first
+    * start are not empty. The counted days are not changed.
+    */
+   void seed(HistoryData &history)
+   {
+      double energy[ENERGY_DAYS] = { 0.0 };
+      time_t covered;
+
+      if (firstTime_ == 0 || history.lastFetched_ == 0 || daysIn_.step_ == 0) {
+         return;
+      }
+      covered = (UtcToLocalTime(firstTime_) + 24 * 60 * 60 - 1) / (24 * 60 * 60) * (24 * 60 * 60);
+      for (int i = 0; i < history.size_; i++) {
+         time_t time  = history.start_ + (time_t) i * history.step_;
+         time_t local = UtcToLocalTime(time);
+
+         if (time > history.lastFetched_ || local >= covered) {
+            break;
+         }
+         if (local >= daysIn_.start_) {
+            int index = (local - daysIn_.start_) / daysIn_.step_;
+
+            if (index < ENERGY_DAYS) {
+               energy[index] += (history.getLow(i) + history.getValue(i)) / 2.0 * history.step_;
+            }
+         }
+      }
+      for (int i = 0; i < ENERGY_DAYS && daysIn_.start_ + (time_t) i * daysIn_.step_ < covered; i++) {
+         daysIn_.setValue(i, energy[i] / 3600000.0);
+      }
+   }
+
+   /* Energy of the bucket which contains the time (0 outside of the history), the time of a day is local. */
+   float getEnergy(HistoryData &history, time_t time)
+   {
+      if (history.step_ > 0 && time >= history.start_) {
+         int index = (time - history.start_) / history.step_;
+
+         if (index < history.size_) {
+            return history.getValue(index);
+         }
+      }
+      return 0.0;
+   }
+
+   /* Fill the history with the positive energy of the local day of every bucket, on the timeline of the other history. */
+   void renderDays(HistoryData &history, HistoryData &timeline)
+   {
+      history.clear();
+      history.setTimeline(timeline.start_, timeline.step_);
+      for (int i = 0; i < history.size_; i++) {
+         time_t time = history.start_ + (time_t) i * history.step_;
+
+         if (time > lastTime_) {
+            break;
+         }
+         history.setValue(i, getEnergy(daysIn_, UtcToLocalTime(time)));
+      }
+      history.lastFetched_ = lastTime_;
+      history.stale_       = timeline.stale_;
+      history.updateMax();
+   }
+
+   /* Read the counter at the position of the open file. */
+   bool load(File &file)
+   {
+      FileHeader header;
+
+      if (file.read((uint8_t *) &header, sizeof(header)) == sizeof(header) &&
+          hoursIn_.load(file) && hoursOut_.load(file) && daysIn_.load(file) && daysOut_.load(file)) {
+         firstTime_ = header.firstTime;
+         lastTime_  = header.lastTime;
+         lastPower_ = header.lastPower;
+         hour_      = header.hour;
+         day_       = header.day;
+         hourIn_    = header.hourIn;
+         hourOut_   = header.hourOut;
+         dayIn_     = header.dayIn;
+         dayOut_    = header.dayOut;
+         return true;
+      }
+      return false;
+   }
+
+   /* Write the counter at the position of the open file. */
+   bool save(File &file)
+   {
+      FileHeader header = { (uint32_t) firstTime_, (uint32_t) lastTime_, lastPower_, (uint32_t) hour_, (uint32_t) day_, hourIn_, hourOut_, dayIn_, dayOut_ };
+
+      return file.write((uint8_t *) &header, sizeof(header)) == sizeof(header) &&
+             hoursIn_.save(file) && hoursOut_.save(file) && daysIn_.save(file) && daysOut_.save(file);
    }
 };
 
@@ -165,7 +656,7 @@ time_t UtcToLocalTime(time_t utcTime)
   
       return makeTime(tmSet);
    }
-   Serial.println("!!! Error on UtcToLocalTime() !!!");
+   LOG_ERROR("!!! Error on UtcToLocalTime() !!!");
    return utcTime;
 }
 
@@ -26,12 +26,15 @@
 #include <HTTPClient.h>
 #include "Config.h"
 #include "ConfigOverride.h" // Remove this line
+#include "Log.h"
 #include "Data.h"
 #include "Display.h"
 #include "Battery.h"
 #include "EPD.h"
 #include "EPDWifi.h"
 #include "IoBroker.h"
+#include "Snapshot.h"
+#include "Health.h"
 #include "SHT30.h"
 #include "RTCTime.h"
 #include "Utils.h"
@@ -40,23 +43,50 @@ MyData       myData;            // The collection of the global data
 SolarDisplay myDisplay(myData); // The global display helper class
 
 
+/* Print the heap and stack health of this wake cycle. */
+void DumpHealth()
+{
+   HealthMonitor health;
+   char          json[192];
+
+   health.addTask("loop");
+   health.sample();
+   health.toJson(json, sizeof(json));
+   LOG_INFO("Health: %s", json);
+}
+
 /* Start and M5Paper instance */
 void setup()
 {
    // Serial default speed 115200
    InitEPD(false);
+   logger.begin();
    myDisplay.ClearUpdateInfo();
+
+   // The last data until the fetch replaces them.
+   time_t snapshotTime = LoadSnapshot(myData);
+
    if (!StartWiFi(myData.wifiRSSI)) {
-      myDisplay.ShowWiFiError(WIFI_SSID);
+      if (snapshotTime > 0) {
+         myData.cachedTime = snapshotTime;
+         GetBatteryValues(myData);
+         GetSHT30Values(myData);
+         myDisplay.Show();
+      } else {
+         myDisplay.ShowWiFiError(WIFI_SSID);
+      }
    } else {
       UpdateRTCFromNTP();
       GetBatteryValues(myData);
       GetSHT30Values(myData);
-      GetIoBrokerValues(myData);
+      if (GetIoBrokerValues(myData)) {
+         SaveSnapshot(myData);
+      }
       myData.Dump();
       myDisplay.Show();
       StopWiFi();
    }
+   DumpHealth();
 
    // Save battery at night.
    if (myData.mppt.batteryCurrent > 0.0) {
@@ -29,3 +29,14 @@
 #define MQTT_PORT     1883                     //!< MQTT Port (Default is 1883)
 #define MQTT_USER     "user"                   //!< MQTT connection user
 #define MQTT_PASSWORD "password"               //!< MQTT connection password
+
+#define LOG_LEVEL     LOG_LEVEL_INFO           //!< LOG_LEVEL_NONE, LOG_LEVEL_ERROR, LOG_LEVEL_INFO or LOG_LEVEL_DEBUG
+
+#define HEALTH_ALERT_MIN_FREE_HEAP 20000       //!< Health alert if the min free heap drops below (bytes)
+#define HEALTH_ALERT_FRAGMENTATION 60          //!< Health alert if the heap fragmentation is higher (%)
+
+#define TASMOTA_SENSOR_TOPIC "tele/TasmotaElite/SENSOR" //!< Tasmota Elite telemetry topic
+#define TASMOTA_LWT_TOPIC    "tele/TasmotaElite/LWT"    //!< Tasmota Elite last will topic
+#define SNAPSHOT_TOPIC       "solar/Snapshot"           //!< Topic of the combined system snapshot
+
+#define NTP_SERVER           "pool.ntp.org"             //!< SNTP server for the acquisition timestamps
@@ -0,0 +1,228 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Snapshot.h
+  *
+  * Combined system snapshot of the BMV, the MPPT and the grid (Tasmota Elite) values.
+  * The consumers get solar, battery and grid power with one time coherent message.
+  */
+#pragma once
+
+#define SNAPSHOT_MAX_VALUES  8   //!< Max values of one group
+#define SNAPSHOT_MAX_PAYLOAD 320 //!< Max length of an incoming Tasmota message
+
+/** BMV values of the snapshot */
+const char * const SNAPSHOT_BMV_KEYWORDS[]  = { "V", "I", "P", "SOC", "TTG", "AR" };
+/** MPPT values of the snapshot */
+const char * const SNAPSHOT_MPPT_KEYWORDS[] = { "V", "I", "PPV", "VPV", "CS", "H20", "ERR" };
+/** Tasmota ENERGY values of the snapshot */
+const char * const SNAPSHOT_GRID_KEYWORDS[] = { "Power", "Voltage", "Current", "Today", "Yesterday", "Total" };
+
+/**
+  * One group of snapshot values with the time of the acquisition.
+  */
+class SnapshotGroup
+{
+public:
+   const char         *name_;                        //!< Json name of the group
+   const char * const *keywords_;                    //!< Labels of the values
+   int                 count_;                       //!< Count of the values
+   float               values_[SNAPSHOT_MAX_VALUES]; //!< The latest values
+   unsigned long       millis_;                      //!< Time of the acquisition (0 = never)
+   uint64_t            time_;                        //!< UTC time of the acquisition (msec, 0 = unknown)
+
+public:
+   SnapshotGroup(const char *name, const char * const *keywords, int count);
+
+   bool setValue(const char *keyword, const char *value);
+   void touch(uint64_t time);
+   int  toJson(char *buffer, int size);
+};
+
+/**
+  * The combined snapshot of all the groups.
+  */
+class SystemSnapshot
+{
+public:
+   SnapshotGroup bmv_;        //!< Battery monitor
+   SnapshotGroup mppt_;       //!< Charge controller
+   SnapshotGroup grid_;       //!< Grid consumption (Tasmota Elite)
+   bool          gridOnline_; //!< Tasmota last will (Online/Offline)
+
+protected:
+   bool parseTasmotaSensor(const char *json);
+
+public:
+   SystemSnapshot();
+
+   void update(SnapshotGroup &group, VEDirectReader &reader);
+   bool onMessage(const char *topic, const byte *payload, unsigned int length);
+   int  toJson(char *buffer, int size);
+};
+
+/* ******************************************** */
+
+SnapshotGroup::SnapshotGroup(const char *name, const char * const *keywords, int count)
+   : name_(name)
+   , keywords_(keywords)
+   , count_(count < SNAPSHOT_MAX_VALUES ? count : SNAPSHOT_MAX_VALUES)
+   , millis_(0)
+   , time_(0)
+{
+   for (int i = 0; i < SNAPSHOT_MAX_VALUES; i++) {
+      values_[i] = 0.0;
+   }
+}
+
+/** Store the value if the label is part of the group. */
+bool SnapshotGroup::setValue(const char *keyword, const char *value)
+{
+   for (int i = 0; i < count_; i++) {
+      if (strcmp(keywords_[i], keyword) == 0) {
+         values_[i] = atof(value);
+         return true;
+      }
+   }
+   return false;
+}
+
+/** Mark the values as acquired at the given UTC time. */
+void SnapshotGroup::touch(uint64_t time)
+{
+   millis_ = millis();
+   time_   = time;
+}
+
+/** Format the group as json object '"name":{"V":123,...,"age":3,"ts":1666000000123}' */
+int SnapshotGroup::toJson(char *buffer, int size)
+{
+   int len = snprintf(buffer, size, "\"%s\":{", name_);
+
+   for (int i = 0; i < count_ && len < size; i++) {
+      len += snprintf(buffer + len, size - len, "\"%s\":%.7g,", keywords_[i], values_[i]);
+   }
+   if (len < size) {
+      long age = millis_ ? (long) ((millis() - millis_) / 1000) : -1;
+
+      if (time_ == 0) {
+         len += snprintf(buffer + len, size - len, "\"age\":%ld,\"ts\":0}", age);
+      } else {
+         len += snprintf(buffer + len, size - len, "\"age\":%ld,\"ts\":%lu%03u}", age,
+                         (unsigned long) (time_ / 1000), (unsigned) (time_ % 1000));
+      }
+   }
+   return len;
+}
+
+/* ******************************************** */
+
+SystemSnapshot::SystemSnapshot()
+   : bmv_ ("bmv",  SNAPSHOT_BMV_KEYWORDS,  KEYWORD_COUNT(SNAPSHOT_BMV_KEYWORDS))
+   , mppt_("mppt", SNAPSHOT_MPPT_KEYWORDS, KEYWORD_COUNT(SNAPSHOT_MPPT_KEYWORDS))
+   , grid_("grid", SNAPSHOT_GRID_KEYWORDS, KEYWORD_COUNT(SNAPSHOT_GRID_KEYWORDS))
+   , gridOnline_(false)
+{
+}
+
+/** Take the values and the acquisition time of one completed and checked ve.direct block. */
+void SystemSnapshot::update(SnapshotGroup &group, VEDirectReader &reader)
+{
+   for (int i = 0; i < reader.getValueCount(); i++) {
+      group.setValue(reader.keywords_[i], reader.values_[i]);
+   }
+   group.touch(reader.frameTime_);
+}
+
+/** Read the ENERGY values of the Tasmota SENSOR message.
+  * {"Time":"...","ENERGY":{"TotalStartTime":"...","Total":12.3,"Yesterday":1.2,"Today":0.4,"Power":45,...}}
+  */
+bool SystemSnapshot::parseTasmotaSensor(const char *json)
+{
+   const char *energy = strstr(json, "\"ENERGY\":{");
+   int         found  = 0;
+
+   if (energy) {
+      for (int i = 0; i < grid_.count_; i++) {
+         char        key[24];
+         const char *pos;
+
+         snprintf(key, sizeof(key), "\"%s\":", grid_.keywords_[i]);
+         pos = strstr(energy, key);
+         if (pos) {
+            grid_.values_[i] = atof(pos + strlen(key));
+            found++;
+         }
+      }
+   }
+   if (found > 0) {
+      grid_.touch(GetEpochMillis());
+      return true;
+   }
+   return false;
+}
+
+/** MQTT callback: take the Tasmota telemetry and last will messages. */
+bool SystemSnapshot::onMessage(const char *topic, const byte *payload, unsigned int length)
+{
+   char message[SNAPSHOT_MAX_PAYLOAD];
+
+   if (length >= sizeof(message)) {
+      LOG_ERROR("Snapshot: message of [%s] too long (%u)", topic, length);
+      return false;
+   }
+   memcpy(message, payload, length);
+   message[length] = '\0';
+
+   if (strcmp(topic, TASMOTA_SENSOR_TOPIC) == 0) {
+      LOG_DEBUG("Snapshot: Tasmota sensor [%s]", message);
+      return parseTasmotaSensor(message);
+   } else if (strcmp(topic, TASMOTA_LWT_TOPIC) == 0) {
+      gridOnline_ = strcmp(message, "Online") == 0;
+      LOG_INFO("Snapshot: Tasmota is %s", message);
+      return true;
+   }
+   return false;
+}
+
+/** Format the complete snapshot as one json document.
+  * {"bmv":{...,"age":2},"mppt":{...,"age":5},"grid":{...,"age":40},"online":1}
+  */
+int SystemSnapshot::toJson(char *buffer, int size)
+{
+   int len = snprintf(buffer, size, "{");
+
+   if (len < size) {
+      len += bmv_.toJson(buffer + len, size - len);
+   }
+   if (len < size) {
+      len += snprintf(buffer + len, size - len, ",");
+   }
+   if (len < size) {
+      len += mppt_.toJson(buffer + len, size - len);
+   }
+   if (len < size) {
+      len += snprintf(buffer + len, size - len, ",");
+   }
+   if (len < size) {
+      len += grid_.toJson(buffer + len, size - len);
+   }
+   if (len < size) {
+      len += snprintf(buffer + len, size - len, ",\"online\":%d}", gridOnline_ ? 1 : 0);
+   }
+   return len < size ? len : size - 1;
+}
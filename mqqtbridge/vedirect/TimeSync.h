@@ -0,0 +1,45 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file TimeSync.h
+  *
+  * SNTP time synchronization for the acquisition timestamps of the ve.direct blocks.
+  */
+#pragma once
+#include <time.h>
+#include <sys/time.h>
+
+#define TIME_VALID_SINCE 1640995200 //!< 2022-01-01, everything before is not synchronized
+
+/** Start the SNTP synchronization (UTC). The SNTP client keeps the time in sync. */
+void SetupTime()
+{
+   LOG_INFO("Start SNTP with %s", NTP_SERVER);
+   configTime(0, 0, NTP_SERVER);
+}
+
+/** Current UTC time in milliseconds since 1970, 0 if not synchronized. */
+uint64_t GetEpochMillis()
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   if (tv.tv_sec <= TIME_VALID_SINCE) {
+      return 0;
+   }
+   return (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
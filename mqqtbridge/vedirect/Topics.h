@@ -0,0 +1,105 @@
+/*
+   Copyright (C) 2022 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Topics.h
+  *
+  * Pre-built MQTT topic strings for the known ve.direct labels.
+  */
+#pragma once
+
+#define TOPIC_MAX_LEN 48 //!< Max length of one topic incl. prefix
+
+/** Known labels of the BMV-712 (see victron-ve-direct-protocol.pdf) */
+const char * const BMV_KEYWORDS[] = {
+   "V", "VS", "VM", "DM", "I", "T", "P", "CE", "SOC", "TTG", "Alarm", "Relay", "AR",
+   "H1", "H2", "H3", "H4", "H5", "H6", "H7", "H8", "H9", "H10", "H11", "H12",
+   "H15", "H16", "H17", "H18", "BMV", "FW", "PID", "MON",
+   "Timestamp" // Acquisition time of the block from the bridge
+};
+
+/** Known labels of the MPPT charge controller */
+const char * const MPPT_KEYWORDS[] = {
+   "V", "VPV", "PPV", "I", "IL", "LOAD", "Relay", "OR", "ERR", "CS", "MPPT",
+   "H19", "H20", "H21", "H22", "H23", "HSDS", "FW", "PID", "SER#",
+   "Timestamp" // Acquisition time of the block from the bridge
+};
+
+/** Labels of the bridge statistic */
+const char * const STATISTIC_KEYWORDS[] = {
+   "BlockCompleted", "CheckSumOk", "CheckSumError", "MqqtSend", "LogDropped"
+};
+
+#define KEYWORD_COUNT(k) (sizeof(k) / sizeof(k[0]))
+
+/**
+  * Table with the complete topic ('prefix/keyword') for every known label.
+  * The topics are built once on startup, unknown labels are formatted
+  * into a scratch buffer.
+  */
+class TopicTable
+{
+protected:
+   const char         *prefix_;                //!< Topic prefix like 'bmv'
+   const char * const *keywords_;              //!< Known labels
+   int                 count_;                 //!< Count of known labels
+   char              (*topics_)[TOPIC_MAX_LEN]; //!< Pre-built topics
+   char                scratch_[TOPIC_MAX_LEN]; //!< Topic of an unknown label
+
+public:
+   TopicTable(const char *prefix, const char * const *keywords, int count);
+
+   void        build();
+   const char *getTopic(const char *keyword);
+};
+
+/* ******************************************** */
+
+TopicTable::TopicTable(const char *prefix, const char * const *keywords, int count)
+   : prefix_(prefix)
+   , keywords_(keywords)
+   , count_(count)
+   , topics_(NULL)
+{
+   scratch_[0] = '\0';
+}
+
+/** Build all the topics. Call this once in setup(). */
+void TopicTable::build()
+{
+   if (!topics_) {
+      topics_ = new char[count_][TOPIC_MAX_LEN];
+      for (int i = 0; i < count_; i++) {
+         snprintf(topics_[i], TOPIC_MAX_LEN, "%s/%s", prefix_, keywords_[i]);
+      }
+   }
+}
+
+/** Get the topic of the label.
+  * The returned pointer of an unknown label is only valid until the next call.
+  */
+const char *TopicTable::getTopic(const char *keyword)
+{
+   if (topics_) {
+      for (int i = 0; i < count_; i++) {
+         if (strcmp(keywords_[i], keyword) == 0) {
+            return topics_[i];
+         }
+      }
+   }
+   snprintf(scratch_, TOPIC_MAX_LEN, "%s/%s", prefix_, keyword);
+   return scratch_;
+}
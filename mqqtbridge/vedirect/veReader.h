@@ -21,20 +21,34 @@
   */
 
 
-#define MAX_KEYWORDS 60
+#define MAX_KEYWORDS    60 //!< Max keyword value pairs of one block
+#define KEYWORD_MAX_LEN 16 //!< Max length of a keyword incl. terminator, longer ones are cut
+#define VALUE_MAX_LEN   36 //!< Max length of a value incl. terminator, longer ones are cut
 
 /**
-  * class to read the ve.direct serial port and store the values in Strings
+  * class to read the ve.direct serial port and store the values in char arrays.
+  * A line can come in with several calls of readLine(), the checksum is
+  * summed up over all bytes of the block.
   */
 class VEDirectReader
 {
 public:
-   HardwareSerial &serial_;                  //!< Hardware serial communication
-   int             index_;                   //!< Index of the keyword value pair Strings
-   bool            blockCompleted_;          //!< Is one block finished?
-   String          keywords_[MAX_KEYWORDS];  //!< Keywords
-   String          values_[MAX_KEYWORDS];    //!< Values
-   
+   HardwareSerial &serial_;                                 //!< Hardware serial communication
+   int             index_;                                  //!< Index of the keyword value pair
+   bool            blockCompleted_;                         //!< Is one block finished?
+   char            keywords_[MAX_KEYWORDS][KEYWORD_MAX_LEN]; //!< Keywords
+   char            values_[MAX_KEYWORDS][VALUE_MAX_LEN];     //!< Values
+   uint64_t        frameTime_;                              //!< UTC time (msec) of the first byte of the block (0 = unknown)
+
+protected:
+   bool            starting_;                               //!< Wait for the first carriage return of the block
+   bool            inValue_;                                //!< The current line is at its value
+   int             length_;                                 //!< Length of the current keyword or value
+   byte            checksum_;                               //!< Sum of all bytes of the block
+
+   void startLine();
+   void append(char *text, int size, char rc);
+
 public:
    VEDirectReader(HardwareSerial &serial);
 
@@ -52,7 +66,11 @@ VEDirectReader::VEDirectReader(HardwareSerial &serial)
    : serial_(serial)
    , index_(0)
    , blockCompleted_(false)
+   , frameTime_(0)
+   , starting_(false)
 {
+   startLine();
+   checksum_ = 0;
 }
 
 /** Reset all the indexes and values. */
@@ -60,6 +78,28 @@ void VEDirectReader::reset()
 {
    index_          = 0;
    blockCompleted_ = false;
+   frameTime_      = 0;
+   starting_       = true;
+   checksum_       = 0;
+   startLine();
+}
+
+/** Clear the keyword and value of the current index for the next line. */
+void VEDirectReader::startLine()
+{
+   keywords_[index_][0] = '\0';
+   values_[index_][0]   = '\0';
+   inValue_             = false;
+   length_              = 0;
+}
+
+/** Add the char to the keyword or value, the rest of a too long one is dropped. */
+void VEDirectReader::append(char *text, int size, char rc)
+{
+   if (length_ < size - 1) {
+      text[length_++] = rc;
+      text[length_]   = '\0';
+   }
 }
 
 /** Get the count of the keyword value pair.
@@ -76,51 +116,30 @@ bool VEDirectReader::isBlockCompleted()
    return blockCompleted_;
 }
 
-/** Is checksum ok? */
+/** Is checksum ok? The sum of all bytes of the block is 0. */
 bool VEDirectReader::isCheckSumOk()
 {
-   byte checksum = 0;
-
-   for (int i = 0; i <= index_; i++) {
-      String keyword = keywords_[i];
-      String value   = values_[i];
-
-      Serial.write(keyword.c_str());
-      Serial.write("-");
-      Serial.write(value.c_str());
-      Serial.write("\n");
-      
-      for (int y = 0; y < keyword.length(); y++) {
-         checksum += keyword[y];
-      }
-      for (int y = 0; y < value.length(); y++) {
-         checksum += value[y];
-      }
+   for (int i = 0; i < index_; i++) {
+      LOG_DEBUG("%s-%s", keywords_[i], values_[i]);
    }
-   checksum += (index_ + 1) * ('\t' + '\r' + '\n');
-
-   // Serial.printf("CheckSum: %d\n", checksum);
-   return checksum == 0;
+   LOG_DEBUG("CheckSum: %d", checksum_);
+   return checksum_ == 0;
 }
 
 /** Read one line from the ve.direct bus.
+  * On the first byte of a block - store the acquisition time
   * On '\t' - change from keyword to value
-  * On '\n' - check if the block is finished
-  * Else add the char to the checksum and
-  * add the char to keyword or value
+  * On '\n' - the line is finished
+  * Else add the char to keyword or value.
+  * Every byte of the block is added to the checksum. The byte after
+  * 'Checksum\t' completes the block, it can have any value.
   */
 bool VEDirectReader::readLine()
 {
-   int  type       = 1;
-   bool isStarting = blockCompleted_;
-
    if (blockCompleted_) {
       reset();
    }
 
-   keywords_[index_] = "";
-   values_[index_]   = "";
-   
    while (serial_.available() > 0) {
       char rc = serial_.read();
 
@@ -131,34 +150,40 @@ bool VEDirectReader::readLine()
       } */
 
       // On start, we wait for the first carriage return
-      if (isStarting && rc != '\r') {
+      if (starting_ && rc != '\r') {
          continue;
       }
-      isStarting = false;
+      starting_ = false;
 
-      if (rc == '\t') {
-         type++;
+      if (index_ == 0 && frameTime_ == 0) {
+         frameTime_ = GetEpochMillis();
+      }
+      checksum_ += (byte) rc;
+
+      if (inValue_ && strcmp(keywords_[index_], "Checksum") == 0) {
+         values_[index_][0] = rc;
+         values_[index_][1] = '\0';
+         blockCompleted_    = true;
+         break;
+      } else if (rc == '\t') {
+         if (!inValue_) {
+            inValue_ = true;
+            length_  = 0;
+         }
       } else if (rc == '\r') {
          // ignore \r
       } else if (rc == '\n') {
-         if (index_ < MAX_KEYWORDS - 1) {
-            // The block starts with cr/nl so we skip
-            // this empty line here.
-            if (!keywords_[index_].isEmpty()) {
-               index_++;
-            }
+         // The block starts with cr/nl so we skip
+         // this empty line here.
+         if (keywords_[index_][0] != '\0' && index_ < MAX_KEYWORDS - 1) {
+            index_++;
          }
+         startLine();
          break;
-      } else { // key or value
-         if (type == 1) {
-            keywords_[index_] += rc;
-         } else { // type = 2
-            values_[index_] += rc;
-            if (keywords_[index_] == "Checksum") {
-              blockCompleted_ = true;
-              break;
-            }         
-         }
+      } else if (!inValue_) {
+         append(keywords_[index_], KEYWORD_MAX_LEN, rc);
+      } else {
+         append(values_[index_], VALUE_MAX_LEN, rc);
       }
       yield();
    }
@@ -22,7 +22,6 @@
 #include <WiFi.h>
 #include <PubSubClient.h>
 #include <HardwareSerial.h>
-#include "vereader.h"
 
 #include "Config.h"
 #define USE_CONFIG_OVERRIDE //!< Switch to use ConfigOverride
@@ -30,15 +29,33 @@
   #include "ConfigOverride.h"
 #endif
 
+#include "Log.h"
+#include "Health.h"
+#include "TimeSync.h"
+#include "Topics.h"
+#include "veReader.h"
+#include "Snapshot.h"
+
 WiFiClient     wifiClient;
 PubSubClient   pubSubClient(wifiClient);
 
 VEDirectReader veDirectReader1(Serial1);
 VEDirectReader veDirectReader2(Serial2);
 
+TopicTable     bmvTopics           ("bmv",              BMV_KEYWORDS,       KEYWORD_COUNT(BMV_KEYWORDS));
+TopicTable     mpptTopics          ("mppt",             MPPT_KEYWORDS,      KEYWORD_COUNT(MPPT_KEYWORDS));
+TopicTable     bmvStatisticTopics  ("bmv/Statistic",    STATISTIC_KEYWORDS, KEYWORD_COUNT(STATISTIC_KEYWORDS));
+TopicTable     mpptStatisticTopics ("mppt/Statistic",   STATISTIC_KEYWORDS, KEYWORD_COUNT(STATISTIC_KEYWORDS));
+TopicTable     bridgeTopics        ("bridge/Statistic", STATISTIC_KEYWORDS, KEYWORD_COUNT(STATISTIC_KEYWORDS));
+
+HealthMonitor  health;
+SystemSnapshot snapshot;
+
 #define SEND_EVEREY_MILLIS  10000
 #define SEND_STATUS_MILLIS  60000
 #define LED_PIN                 2
+#define HEALTH_TOPIC            "bridge/Health"
+#define MQTT_BUFFER_SIZE        512
 
 int     bmvBlockCompleted  = 0;
 int     bmvCheckSumOk      = 0;
@@ -54,31 +71,39 @@ void SetupWifi()
 {
    delay(10);
    // We start by connecting to a WiFi network
-   Serial.println();
-   Serial.print("Connecting to ");
-   Serial.println(WIFI_SID);
+   LOG_INFO("Connecting to %s", WIFI_SID);
 
    WiFi.begin(WIFI_SID, WIFI_PW);
 
    // Wait max 10 seconds for connection
    for (int i = 0; WiFi.status() != WL_CONNECTED && i < 20; i++) {  
       delay(500);
-      Serial.print(".");
    }
-   Serial.println("");
    if (WiFi.status() != WL_CONNECTED) {
-      Serial.println("WiFi connection failed!!!");
+      LOG_ERROR("WiFi connection failed!!!");
    } else {
-      Serial.println("WiFi connected");
-      Serial.println("IP address: ");
-      Serial.println(WiFi.localIP());
+      LOG_INFO("WiFi connected, IP address: %s", WiFi.localIP().toString().c_str());
    }
+   SetupTime();
 }
 
-/** Set the MQQT server */
+/** Incoming MQTT message (Tasmota Elite telemetry). */
+void OnMqttMessage(char *topic, byte *payload, unsigned int length)
+{
+   snapshot.onMessage(topic, payload, length);
+}
+
+/** Set the MQQT server and build the topic tables */
 void SetupMqqt()
 {
    pubSubClient.setServer(MQTT_SERVER, MQTT_PORT);
+   pubSubClient.setBufferSize(MQTT_BUFFER_SIZE);
+   pubSubClient.setCallback(OnMqttMessage);
+   bmvTopics.build();
+   mpptTopics.build();
+   bmvStatisticTopics.build();
+   mpptStatisticTopics.build();
+   bridgeTopics.build();
 }
 
 /** Checks the wifi and mqqt connection and connect if needed. */
@@ -91,44 +116,88 @@ void Reconnect()
    
    // Loop until we're reconnected (5 retries)
    for (int i = 0; !pubSubClient.connected() && i < 5; i++) {  
-      Serial.print("Attempting MQTT connection...");
+      LOG_INFO("Attempting MQTT connection...");
       // Attempt to connect
       // If you do not want to use a username and password, change next line to
       // if (client.connect(MQTT_NAME)) {
       if (pubSubClient.connect(MQTT_NAME, MQTT_USER, MQTT_PASSWORD)) {
-         Serial.println("connected");
+         LOG_INFO("MQTT connected");
+         pubSubClient.subscribe(TASMOTA_SENSOR_TOPIC);
+         pubSubClient.subscribe(TASMOTA_LWT_TOPIC);
       } else {
-         Serial.print("failed, rc=");
-         Serial.print(pubSubClient.state());
-         Serial.println(" try again in 5 seconds");
+         LOG_ERROR("MQTT failed, rc=%d try again in 5 seconds", pubSubClient.state());
          // Wait 5 seconds before retrying
          delay(5000);
       }
    }
    if (!pubSubClient.connected()) {
-      Serial.println("MQTT failed!!!");
+      LOG_ERROR("MQTT failed!!!");
    }
 }
 
-/** Publish one value to the server. */
-void Publish(String prefix, String keyword, String value)
+/** Publish one value to the server without any temporary String. */
+void Publish(TopicTable &topics, const char *keyword, const char *value)
 {
    // Ignore empty keywords and ignore hex data ':'
-   if (!keyword.isEmpty() && keyword[0] != ':') {
-      String topic = prefix + "/" + keyword;
+   if (keyword[0] != '\0' && keyword[0] != ':') {
+      const char *topic = topics.getTopic(keyword);
 
-      Serial.println((String) "publish: [" + topic + "]=[" + value + "]");
-      pubSubClient.publish(topic.c_str(), value.c_str(), true);
+      LOG_DEBUG("publish: [%s]=[%s]", topic, value);
+      pubSubClient.publish(topic, (const uint8_t *) value, strlen(value), true);
       // We need a small delay here otherwise the values will not arrive correctly.
       delay(10);
       yield();
    }
 }
 
+/** Publish one counter value, formatted into a scratch buffer. */
+void Publish(TopicTable &topics, const char *keyword, uint32_t value)
+{
+   char buffer[12];
+
+   snprintf(buffer, sizeof(buffer), "%u", value);
+   Publish(topics, keyword, buffer);
+}
+
+/** Publish the acquisition time (UTC seconds) of a block if the time is synchronized. */
+void PublishTimestamp(TopicTable &topics, VEDirectReader &reader)
+{
+   if (reader.frameTime_ != 0) {
+      Publish(topics, "Timestamp", (uint32_t) (reader.frameTime_ / 1000));
+   }
+}
+
+/** Sample the heap and stack health and publish it as one json document. */
+void PublishHealth()
+{
+   char json[192];
+   int  len;
+
+   health.sample();
+   len = health.toJson(json, sizeof(json));
+   if (health.isAlert()) {
+      LOG_ERROR("Health alert: %s", json);
+   }
+   pubSubClient.publish(HEALTH_TOPIC, (const uint8_t *) json, len, true);
+}
+
+/** Publish the combined BMV, MPPT and grid snapshot. */
+void PublishSnapshot()
+{
+   char json[MQTT_BUFFER_SIZE - 64];
+   int  len = snapshot.toJson(json, sizeof(json));
+
+   LOG_DEBUG("publish: [%s]", SNAPSHOT_TOPIC);
+   pubSubClient.publish(SNAPSHOT_TOPIC, (const uint8_t *) json, len, true);
+}
+
 /** Main setup function. */
 void setup() 
 {
    Serial.begin(19200);
+   logger.begin();
+   health.addTask("loop");
+   health.addTask("log", logger.getTask());
    Serial1.begin(19200, SERIAL_8N1, 27, 26);
    Serial2.begin(19200);
    pinMode(LED_PIN, OUTPUT);
@@ -147,19 +216,22 @@ void loop()
    static unsigned long ms1 = 0;
    static unsigned long ms2 = 0;
    static unsigned long ms3 = 0;
+   static unsigned long ms4 = 0;
 
+   health.loopTick();
    veDirectReader1.readLine();
    veDirectReader2.readLine();
    digitalWrite(LED_PIN, LOW);
 
    if (veDirectReader1.isBlockCompleted()) {
       bmvBlockCompleted++;
-      Serial.println("BMV block completed");
+      LOG_DEBUG("BMV block completed");
       if (!veDirectReader1.isCheckSumOk()) {
-         Serial.println(" -> Checksum Error!");
+         LOG_ERROR("BMV -> Checksum Error!");
          bmvCheckSumError++;
       } else {
          bmvCheckSumOk++;
+         snapshot.update(snapshot.bmv_, veDirectReader1);
          digitalWrite(LED_PIN, HIGH);
          delay(10);
          // Send only every x seconds
@@ -170,10 +242,11 @@ void loop()
                Reconnect();
             }
             if (pubSubClient.connected()) {
-               Serial.println("BMV: publish to mqqt server.");
+               LOG_INFO("BMV: publish to mqqt server.");
                for (int i = 0; i < veDirectReader1.getValueCount(); i++) {
-                  Publish("bmv", veDirectReader1.keywords_[i], veDirectReader1.values_[i]);
+                  Publish(bmvTopics, veDirectReader1.keywords_[i], veDirectReader1.values_[i]);
                }   
+               PublishTimestamp(bmvTopics, veDirectReader1);
                pubSubClient.loop();
                bmvMqqtSend++;
             }
@@ -183,12 +256,13 @@ void loop()
    
    if (veDirectReader2.isBlockCompleted()) {
       mpptBlockCompleted++;
-      Serial.println("MPPT block completed");
+      LOG_DEBUG("MPPT block completed");
       if (!veDirectReader2.isCheckSumOk()) {
-         Serial.println(" -> Checksum Error!");
+         LOG_ERROR("MPPT -> Checksum Error!");
          mpptCheckSumError++;
       } else {
          mpptCheckSumOk++;
+         snapshot.update(snapshot.mppt_, veDirectReader2);
          digitalWrite(LED_PIN, HIGH);
          delay(10);
          // Send only every x seconds
@@ -199,10 +273,11 @@ void loop()
                Reconnect();
             }
             if (pubSubClient.connected()) {
-               Serial.println("MPPT: publish to mqqt server.");
+               LOG_INFO("MPPT: publish to mqqt server.");
                for (int i = 0; i < veDirectReader2.getValueCount() - 1; i++) {
-                  Publish("mppt", veDirectReader2.keywords_[i], veDirectReader2.values_[i]);
+                  Publish(mpptTopics, veDirectReader2.keywords_[i], veDirectReader2.values_[i]);
                }   
+               PublishTimestamp(mpptTopics, veDirectReader2);
                pubSubClient.loop();
                mpptMqqtSend++;
             }
@@ -210,6 +285,15 @@ void loop()
       }
    }
    
+   // Send the combined snapshot only every x seconds
+   if (millis() - ms4 > SEND_EVEREY_MILLIS) {
+      ms4 = millis();
+
+      if (pubSubClient.connected()) {
+         PublishSnapshot();
+      }
+   }
+
    // Send only every x seconds
    if (millis() - ms3 > SEND_STATUS_MILLIS) {
       ms3 = millis();
@@ -218,18 +302,22 @@ void loop()
          Reconnect();
       }
       if (pubSubClient.connected()) {
-         Serial.println("SOLAR: publish status to mqqt server.");
-         Publish("bmv/Statistic",  "BlockCompleted", String(bmvBlockCompleted));
-         Publish("bmv/Statistic",  "CheckSumOk",     String(bmvCheckSumOk));
-         Publish("bmv/Statistic",  "CheckSumError",  String(bmvCheckSumError));
-         Publish("bmv/Statistic",  "MqqtSend",       String(bmvMqqtSend));
-         Publish("mppt/Statistic", "BlockCompleted", String(mpptBlockCompleted));
-         Publish("mppt/Statistic", "CheckSumOk",     String(mpptCheckSumOk));
-         Publish("mppt/Statistic", "CheckSumError",  String(mpptCheckSumError));
-         Publish("mppt/Statistic", "MqqtSend",       String(mpptMqqtSend));
+         LOG_INFO("SOLAR: publish status to mqqt server.");
+         Publish(bmvStatisticTopics,  "BlockCompleted", bmvBlockCompleted);
+         Publish(bmvStatisticTopics,  "CheckSumOk",     bmvCheckSumOk);
+         Publish(bmvStatisticTopics,  "CheckSumError",  bmvCheckSumError);
+         Publish(bmvStatisticTopics,  "MqqtSend",       bmvMqqtSend);
+         Publish(mpptStatisticTopics, "BlockCompleted", mpptBlockCompleted);
+         Publish(mpptStatisticTopics, "CheckSumOk",     mpptCheckSumOk);
+         Publish(mpptStatisticTopics, "CheckSumError",  mpptCheckSumError);
+         Publish(mpptStatisticTopics, "MqqtSend",       mpptMqqtSend);
+         Publish(bridgeTopics,        "LogDropped",     logger.getDropped());
+         PublishHealth();
          pubSubClient.loop();
       }
    }
+   // Receive the subscribed Tasmota messages
+   pubSubClient.loop();
    yield();
    delay(10); 
 }